@@ -0,0 +1,58 @@
+#pragma once
+
+// actions for the &rgbled_widget behavior, used as the first parameter with 0 as the second
+#define RGBLED_BATTERY 0x100      // indicate battery level
+#define RGBLED_CONNECTIVITY 0x101 // indicate connectivity status
+#define RGBLED_LAYER 0x102        // indicate highest active layer
+#define RGBLED_STATS 0x103        // log statistics, with CONFIG_RGBLED_WIDGET_STATS
+#define RGBLED_BRIGHTNESS 0x104   // cycle through brightness levels, for PWM LEDs and LED strips
+#define RGBLED_TOGGLE 0x105       // turn all indicators off or back on
+
+// show the n-th pattern of the zmk,rgbled-widget-patterns node, with an argument as the second
+// parameter that RGBLED_ARG steps take their color and repeat count from, the count being at
+// most RGBLED_PATTERN_MAX_COUNT
+#define RGBLED_PATTERN(n) (0x200 + (n))
+#define RGBLED_PATTERN_ARG(color, count) ((color) | ((count) << 3))
+#define RGBLED_PATTERN_MAX_COUNT 31
+
+// config items for the &rgbled_widget behavior, used as the first parameter with
+// CONFIG_RGBLED_WIDGET_RUNTIME_CONFIG
+#define RGBLED_CFG_RESET 0 // restore all items to their Kconfig values
+#define RGBLED_CFG_INTERVAL_MS 1
+#define RGBLED_CFG_BATTERY_BLINK_MS 2
+#define RGBLED_CFG_CONN_BLINK_MS 3
+#define RGBLED_CFG_LAYER_BLINK_MS 4
+#define RGBLED_CFG_BATTERY_LEVEL_HIGH 5
+#define RGBLED_CFG_BATTERY_LEVEL_LOW 6
+#define RGBLED_CFG_BATTERY_LEVEL_CRITICAL 7
+#define RGBLED_CFG_BATTERY_COLOR_HIGH 8
+#define RGBLED_CFG_BATTERY_COLOR_MEDIUM 9
+#define RGBLED_CFG_BATTERY_COLOR_LOW 10
+#define RGBLED_CFG_BATTERY_COLOR_CRITICAL 11
+#define RGBLED_CFG_BATTERY_COLOR_MISSING 12
+#define RGBLED_CFG_CONN_COLOR_CONNECTED 13
+#define RGBLED_CFG_CONN_COLOR_ADVERTISING 14
+#define RGBLED_CFG_CONN_COLOR_DISCONNECTED 15
+#define RGBLED_CFG_CONN_COLOR_USB 16
+#define RGBLED_CFG_LAYER_COLOR 17
+#define RGBLED_CFG_LAYER_N_COLOR(n) (32 + (n)) // persistent color for keymap layer n
+
+// values for the second parameter: a color, level percentage or duration in ms, or a step
+#define RGBLED_CFG_INC 0xFFFF // next color, or 5% or 50 ms more
+#define RGBLED_CFG_DEC 0xFFFE // previous color, or 5% or 50 ms less
+#define RGBLED_CFG_MS_MAX 0xFFFD // longest duration, below the steps
+
+#define RGBLED_BLACK 0
+#define RGBLED_RED 1
+#define RGBLED_GREEN 2
+#define RGBLED_YELLOW 3
+#define RGBLED_BLUE 4
+#define RGBLED_MAGENTA 5
+#define RGBLED_CYAN 6
+#define RGBLED_WHITE 7
+
+// special values for pattern steps: color or repeat count from the argument, and the configured
+// blink duration of the priority class or interval between blinks
+#define RGBLED_ARG 0xFFFF
+#define RGBLED_MS_BLINK 0xFFFF
+#define RGBLED_MS_INTERVAL 0xFFFE
@@ -1,10 +1,11 @@
-#define SHOW_LAYER_CHANGE                                                                          \
-    (IS_ENABLED(CONFIG_RGBLED_WIDGET_SHOW_LAYER_CHANGE)) &&                                        \
-        (!IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL))
+// the layer state is known on the central and, if it is relayed from there, on peripherals
+#define HAS_LAYER_STATE                                                                            \
+    (!IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL) ||                 \
+     IS_ENABLED(CONFIG_RGBLED_WIDGET_LAYER_RELAY))
 
-#define SHOW_LAYER_COLORS                                                                          \
-    (IS_ENABLED(CONFIG_RGBLED_WIDGET_SHOW_LAYER_COLORS)) &&                                        \
-        (!IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL))
+#define SHOW_LAYER_CHANGE (IS_ENABLED(CONFIG_RGBLED_WIDGET_SHOW_LAYER_CHANGE) && HAS_LAYER_STATE)
+
+#define SHOW_LAYER_COLORS (IS_ENABLED(CONFIG_RGBLED_WIDGET_SHOW_LAYER_COLORS) && HAS_LAYER_STATE)
 
 #if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
 void indicate_battery(void);
@@ -14,6 +15,39 @@ void indicate_battery(void);
 void indicate_connectivity(void);
 #endif
 
-#if !IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL)
+#if HAS_LAYER_STATE
 void indicate_layer(void);
 #endif
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_LAYER_RELAY) && !IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL)
+void update_relayed_layer(uint8_t layer);
+#endif
+
+void rgbled_widget_log_stats(void);
+
+void rgbled_widget_cycle_brightness(void);
+
+void rgbled_widget_toggle(void);
+
+int rgbled_widget_show_pattern(uint8_t index, uint32_t arg);
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_RUNTIME_CONFIG)
+int rgbled_widget_config_set(uint32_t id, uint32_t value);
+#endif
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+// statistics counters summed over all priority classes, and the largest queue length
+struct rgbled_widget_stats {
+    uint32_t queued;
+    uint32_t superseded;
+    uint32_t unchanged;
+    uint32_t dropped;
+    uint8_t queue_high_water;
+    // layers sent by the layer relay
+    uint32_t relayed;
+};
+
+void rgbled_widget_get_stats(struct rgbled_widget_stats *stats);
+
+void rgbled_widget_reset_stats(void);
+#endif
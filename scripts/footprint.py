@@ -0,0 +1,196 @@
+#!/usr/bin/env python3
+"""Report the ROM/RAM footprint of the widget for each build.yaml target and feature set.
+
+Run from a ZMK checkout with an initialized west workspace, e.g.
+
+    python3 /path/to/zmk-rgbled-widget/scripts/footprint.py --app app
+
+Each board and shield combination from build.yaml is built once per feature set below, and the
+text, data and bss sizes of the widget and the whole firmware are printed as a markdown table. The
+widget sizes are taken from the linker map of the linked firmware, so they only count the input
+sections from the widget objects that were kept by the linker, after garbage collection.
+
+Save a report with --save and pass it to --compare on a later run to show the differences.
+"""
+
+import argparse
+import json
+import re
+import subprocess
+import sys
+from pathlib import Path
+
+import yaml
+
+MODULE_DIR = Path(__file__).resolve().parent.parent
+
+# feature sets to build, as Kconfig overrides on top of each target's defaults
+FEATURES = {
+    "default": [],
+    "strip-strings": ["CONFIG_RGBLED_WIDGET_STRIP_STRINGS=y"],
+    "workqueue": ["CONFIG_RGBLED_WIDGET_SEQUENCER_WORKQUEUE=y"],
+    "layer-colors": ["CONFIG_RGBLED_WIDGET_SHOW_LAYER_COLORS=y"],
+    "runtime-config": ["CONFIG_RGBLED_WIDGET_RUNTIME_CONFIG=y"],
+    "battery-history": ["CONFIG_RGBLED_WIDGET_BATTERY_HISTORY=y"],
+    "stats": ["CONFIG_RGBLED_WIDGET_STATS=y"],
+    "gpio-port": ["CONFIG_RGBLED_WIDGET_GPIO_PORT=y"],
+}
+
+# object files built from the module sources, as named in the linker map
+WIDGET_OBJECTS = ("widget.c.obj", "behavior_rgbled_widget.c.obj",
+                  "behavior_rgbled_widget_layer_sync.c.obj")
+
+
+def load_targets(build_yaml):
+    with open(build_yaml) as f:
+        matrix = yaml.safe_load(f) or {}
+
+    targets = list(matrix.get("include", []))
+    for board in matrix.get("board", []):
+        for shield in matrix.get("shield", [None]):
+            targets.append({"board": board, "shield": shield} if shield else {"board": board})
+    return targets
+
+
+def target_name(target):
+    name = target["board"].replace("/", "_")
+    if target.get("shield"):
+        name += "-" + target["shield"].replace(" ", "-")
+    return name
+
+
+def bintool(build_dir, name, default):
+    cache = (build_dir / "CMakeCache.txt").read_text()
+    match = re.search(rf"^{name}:FILEPATH=(.+)$", cache, re.MULTILINE)
+    return match.group(1) if match else default
+
+
+def sizes(tool, paths):
+    """Sum the text, data and bss sizes of the given files."""
+    out = subprocess.run([tool, *map(str, paths)], check=True, capture_output=True, text=True)
+    total = [0, 0, 0]
+    for line in out.stdout.splitlines()[1:]:
+        fields = line.split()
+        for i in range(3):
+            total[i] += int(fields[i])
+    return total
+
+
+def build(args, target, feature, build_dir):
+    cmd = ["west", "build", "-p", "-s", args.app, "-d", str(build_dir), "-b", target["board"]]
+    if target.get("snippet"):
+        cmd += ["-S", target["snippet"]]
+    cmd += ["--", f"-DZMK_CONFIG={MODULE_DIR / 'config'}", f"-DZMK_EXTRA_MODULES={MODULE_DIR}"]
+    if target.get("shield"):
+        cmd.append(f"-DSHIELD={target['shield']}")
+    cmd += target.get("cmake-args", "").split()
+    cmd += ["-D" + option for option in FEATURES[feature]]
+
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.stderr.write(result.stdout[-4000:] + result.stderr[-4000:])
+    return result.returncode == 0
+
+
+def section_kinds(tool, elf):
+    """Map the allocated output sections of the ELF file to 0 (text), 1 (data) or 2 (bss)."""
+    out = subprocess.run([tool, "-S", "-W", str(elf)], check=True, capture_output=True,
+                         text=True)
+    kinds = {}
+    for match in re.finditer(r"^\s*\[\s*\d+\]\s+(\S+)\s+(\S+)\s+(?:[0-9a-f]+\s+){4}(\w*)\s",
+                             out.stdout, re.MULTILINE):
+        name, kind, flags = match.groups()
+        if "A" not in flags:
+            continue
+        kinds[name] = 2 if kind == "NOBITS" else 1 if "W" in flags else 0
+    return kinds
+
+
+def widget_sizes(map_file, kinds):
+    """Sum the text, data and bss sizes of the input sections from the widget objects.
+
+    Only the memory map part of the linker map is parsed, which lists the input sections placed in
+    each output section, so discarded sections are not counted.
+    """
+    total = [0, 0, 0]
+    output = None
+    pending = None
+    lines = map_file.read_text().splitlines()
+    start = lines.index("Linker script and memory map") + 1
+    for line in lines[start:]:
+        if line and not line[0].isspace():
+            output = line.split()[0]
+            pending = None
+            continue
+        fields = line.split()
+        # long input section names put the address, size and file on the next line
+        if len(fields) == 1 and not fields[0].startswith("0x"):
+            pending = fields[0]
+            continue
+        if pending and len(fields) >= 3 and fields[0].startswith("0x"):
+            fields = [pending] + fields
+        pending = None
+        if (len(fields) < 4 or not fields[0].startswith((".", "COMMON"))
+                or not fields[2].startswith("0x")):
+            continue
+        source = " ".join(fields[3:])
+        if output in kinds and any(source.endswith((f"({name})", f"/{name}"))
+                                   for name in WIDGET_OBJECTS):
+            total[kinds[output]] += int(fields[2], 16)
+    return total
+
+
+def measure(build_dir):
+    elf = build_dir / "zephyr/zmk.elf"
+    kinds = section_kinds(bintool(build_dir, "CMAKE_READELF", "readelf"), elf)
+    widget = widget_sizes(elf.with_suffix(".map"), kinds)
+    if not any(widget):
+        raise ValueError(f"No widget sections found in {elf.with_suffix('.map')}")
+    return {"widget": widget, "firmware": sizes(bintool(build_dir, "CMAKE_SIZE", "size"), [elf])}
+
+
+def cell(value, old):
+    if old is None or old == value:
+        return str(value)
+    return f"{value} ({value - old:+d})"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--app", default="app", help="path to the ZMK app directory")
+    parser.add_argument("--build-dir", default="build/footprint", help="directory for the builds")
+    parser.add_argument("--features", nargs="+", choices=FEATURES, default=list(FEATURES),
+                        help="feature sets to build")
+    parser.add_argument("--save", type=Path, help="write the results to a JSON file")
+    parser.add_argument("--compare", type=Path, help="show differences to a saved JSON file")
+    args = parser.parse_args()
+
+    baseline = json.loads(args.compare.read_text()) if args.compare else {}
+    results = {}
+    failed = False
+
+    print("| Target | Features | Widget text | Widget data | Widget bss | Firmware text | "
+          "Firmware data | Firmware bss |")
+    print("| --- | --- | --- | --- | --- | --- | --- | --- |")
+    for target in load_targets(MODULE_DIR / "build.yaml"):
+        for feature in args.features:
+            key = f"{target_name(target)}/{feature}"
+            build_dir = Path(args.build_dir) / target_name(target) / feature
+            if not build(args, target, feature, build_dir):
+                print(f"| {target_name(target)} | {feature} | build failed | | | | | |")
+                failed = True
+                continue
+
+            results[key] = measure(build_dir)
+            old = baseline.get(key, {})
+            row = [cell(results[key][part][i], old.get(part, [None] * 3)[i])
+                   for part in ("widget", "firmware") for i in range(3)]
+            print(f"| {target_name(target)} | {feature} | " + " | ".join(row) + " |", flush=True)
+
+    if args.save:
+        args.save.write_text(json.dumps(results, indent=2) + "\n")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
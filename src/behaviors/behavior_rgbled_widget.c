@@ -4,41 +4,202 @@
 #include <drivers/behavior.h>
 #include <zephyr/logging/log.h>
 
+#include <dt-bindings/zmk/rgbled_widget.h>
 #include <zmk/behavior.h>
+#include <zmk/keymap.h>
 
 #include <zmk_rgbled_widget/widget.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
-struct behavior_rgb_wdg_config {
-    bool indicate_battery;
-    bool indicate_connectivity;
-    bool indicate_layer;
+#if IS_ENABLED(CONFIG_ZMK_BEHAVIOR_METADATA)
+static const struct behavior_parameter_value_metadata action_values[] = {
+    {.display_name = "Battery",
+     .type = BEHAVIOR_PARAMETER_VALUE_TYPE_VALUE,
+     .value = RGBLED_BATTERY},
+    {.display_name = "Connectivity",
+     .type = BEHAVIOR_PARAMETER_VALUE_TYPE_VALUE,
+     .value = RGBLED_CONNECTIVITY},
+    {.display_name = "Layer", .type = BEHAVIOR_PARAMETER_VALUE_TYPE_VALUE, .value = RGBLED_LAYER},
+    {.display_name = "Statistics",
+     .type = BEHAVIOR_PARAMETER_VALUE_TYPE_VALUE,
+     .value = RGBLED_STATS},
+    {.display_name = "Cycle Brightness",
+     .type = BEHAVIOR_PARAMETER_VALUE_TYPE_VALUE,
+     .value = RGBLED_BRIGHTNESS},
+    {.display_name = "Toggle", .type = BEHAVIOR_PARAMETER_VALUE_TYPE_VALUE, .value = RGBLED_TOGGLE},
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_RUNTIME_CONFIG)
+    {.display_name = "Reset Settings",
+     .type = BEHAVIOR_PARAMETER_VALUE_TYPE_VALUE,
+     .value = RGBLED_CFG_RESET},
+#endif
+};
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_RUNTIME_CONFIG)
+#define CFG_VALUE(name, item)                                                                      \
+    {.display_name = name, .type = BEHAVIOR_PARAMETER_VALUE_TYPE_VALUE, .value = item}
+
+static const struct behavior_parameter_value_metadata duration_items[] = {
+    CFG_VALUE("Interval", RGBLED_CFG_INTERVAL_MS),
+    CFG_VALUE("Battery Blink", RGBLED_CFG_BATTERY_BLINK_MS),
+    CFG_VALUE("Connectivity Blink", RGBLED_CFG_CONN_BLINK_MS),
+    CFG_VALUE("Layer Blink", RGBLED_CFG_LAYER_BLINK_MS),
+};
+
+static const struct behavior_parameter_value_metadata level_items[] = {
+    CFG_VALUE("Battery Level High", RGBLED_CFG_BATTERY_LEVEL_HIGH),
+    CFG_VALUE("Battery Level Low", RGBLED_CFG_BATTERY_LEVEL_LOW),
+    CFG_VALUE("Battery Level Critical", RGBLED_CFG_BATTERY_LEVEL_CRITICAL),
+};
+
+static const struct behavior_parameter_value_metadata color_items[] = {
+    CFG_VALUE("Battery Color High", RGBLED_CFG_BATTERY_COLOR_HIGH),
+    CFG_VALUE("Battery Color Medium", RGBLED_CFG_BATTERY_COLOR_MEDIUM),
+    CFG_VALUE("Battery Color Low", RGBLED_CFG_BATTERY_COLOR_LOW),
+    CFG_VALUE("Battery Color Critical", RGBLED_CFG_BATTERY_COLOR_CRITICAL),
+    CFG_VALUE("Battery Color Missing", RGBLED_CFG_BATTERY_COLOR_MISSING),
+    CFG_VALUE("Connected Color", RGBLED_CFG_CONN_COLOR_CONNECTED),
+    CFG_VALUE("Advertising Color", RGBLED_CFG_CONN_COLOR_ADVERTISING),
+    CFG_VALUE("Disconnected Color", RGBLED_CFG_CONN_COLOR_DISCONNECTED),
+    CFG_VALUE("USB Color", RGBLED_CFG_CONN_COLOR_USB),
+    CFG_VALUE("Layer Color", RGBLED_CFG_LAYER_COLOR),
+    {.display_name = "Layer N Color",
+     .type = BEHAVIOR_PARAMETER_VALUE_TYPE_RANGE,
+     .range = {.min = RGBLED_CFG_LAYER_N_COLOR(0),
+               .max = RGBLED_CFG_LAYER_N_COLOR(ZMK_KEYMAP_LAYERS_LEN - 1)}},
+};
+
+static const struct behavior_parameter_value_metadata duration_values[] = {
+    {.display_name = "Duration (ms)",
+     .type = BEHAVIOR_PARAMETER_VALUE_TYPE_RANGE,
+     .range = {.min = 0, .max = RGBLED_CFG_MS_MAX}},
+    CFG_VALUE("Increase", RGBLED_CFG_INC),
+    CFG_VALUE("Decrease", RGBLED_CFG_DEC),
+};
+
+static const struct behavior_parameter_value_metadata level_values[] = {
+    {.display_name = "Percentage",
+     .type = BEHAVIOR_PARAMETER_VALUE_TYPE_RANGE,
+     .range = {.min = 0, .max = 100}},
+    CFG_VALUE("Increase", RGBLED_CFG_INC),
+    CFG_VALUE("Decrease", RGBLED_CFG_DEC),
+};
+
+static const struct behavior_parameter_value_metadata color_values[] = {
+    CFG_VALUE("Black", RGBLED_BLACK),
+    CFG_VALUE("Red", RGBLED_RED),
+    CFG_VALUE("Green", RGBLED_GREEN),
+    CFG_VALUE("Yellow", RGBLED_YELLOW),
+    CFG_VALUE("Blue", RGBLED_BLUE),
+    CFG_VALUE("Magenta", RGBLED_MAGENTA),
+    CFG_VALUE("Cyan", RGBLED_CYAN),
+    CFG_VALUE("White", RGBLED_WHITE),
+    CFG_VALUE("Next", RGBLED_CFG_INC),
+    CFG_VALUE("Previous", RGBLED_CFG_DEC),
+};
+#endif // IS_ENABLED(CONFIG_RGBLED_WIDGET_RUNTIME_CONFIG)
+
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_rgbled_widget_patterns)
+#define PATTERNS_NODE_ID DT_COMPAT_GET_ANY_STATUS_OKAY(zmk_rgbled_widget_patterns)
+
+static const struct behavior_parameter_value_metadata pattern_items[] = {
+    {.display_name = "Pattern",
+     .type = BEHAVIOR_PARAMETER_VALUE_TYPE_RANGE,
+     .range = {.min = RGBLED_PATTERN(0),
+               .max = RGBLED_PATTERN(DT_CHILD_NUM_STATUS_OKAY(PATTERNS_NODE_ID) - 1)}},
 };
 
+// a color, or a color plus 8 times a repeat count, as encoded by RGBLED_PATTERN_ARG
+static const struct behavior_parameter_value_metadata pattern_values[] = {
+    {.display_name = "Argument",
+     .type = BEHAVIOR_PARAMETER_VALUE_TYPE_RANGE,
+     .range = {.min = 0, .max = RGBLED_PATTERN_ARG(RGBLED_WHITE, RGBLED_PATTERN_MAX_COUNT)}},
+};
+#endif
+
+static const struct behavior_parameter_metadata_set metadata_sets[] = {
+    {
+        .param1_values = action_values,
+        .param1_values_len = ARRAY_SIZE(action_values),
+    },
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_RUNTIME_CONFIG)
+    {
+        .param1_values = duration_items,
+        .param1_values_len = ARRAY_SIZE(duration_items),
+        .param2_values = duration_values,
+        .param2_values_len = ARRAY_SIZE(duration_values),
+    },
+    {
+        .param1_values = level_items,
+        .param1_values_len = ARRAY_SIZE(level_items),
+        .param2_values = level_values,
+        .param2_values_len = ARRAY_SIZE(level_values),
+    },
+    {
+        .param1_values = color_items,
+        .param1_values_len = ARRAY_SIZE(color_items),
+        .param2_values = color_values,
+        .param2_values_len = ARRAY_SIZE(color_values),
+    },
+#endif
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_rgbled_widget_patterns)
+    {
+        .param1_values = pattern_items,
+        .param1_values_len = ARRAY_SIZE(pattern_items),
+        .param2_values = pattern_values,
+        .param2_values_len = ARRAY_SIZE(pattern_values),
+    },
+#endif
+};
+
+static const struct behavior_parameter_metadata metadata = {
+    .sets_len = ARRAY_SIZE(metadata_sets),
+    .sets = metadata_sets,
+};
+#endif // IS_ENABLED(CONFIG_ZMK_BEHAVIOR_METADATA)
+
 static int behavior_rgb_wdg_init(const struct device *dev) { return 0; }
 
 static int on_keymap_binding_pressed(struct zmk_behavior_binding *binding,
                                      struct zmk_behavior_binding_event event) {
 #if IS_ENABLED(CONFIG_RGBLED_WIDGET)
-    const struct device *dev = zmk_behavior_get_binding(binding->behavior_dev);
-    const struct behavior_rgb_wdg_config *cfg = dev->config;
-
+    switch (binding->param1) {
 #if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
-    if (cfg->indicate_battery) {
+    case RGBLED_BATTERY:
         indicate_battery();
-    }
+        break;
 #endif
 #if IS_ENABLED(CONFIG_ZMK_USB) || IS_ENABLED(CONFIG_ZMK_BLE)
-    if (cfg->indicate_connectivity) {
+    case RGBLED_CONNECTIVITY:
         indicate_connectivity();
-    }
+        break;
 #endif
-#if !IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL)
-    if (cfg->indicate_layer) {
+#if HAS_LAYER_STATE
+    case RGBLED_LAYER:
         indicate_layer();
-    }
+        break;
 #endif
+    case RGBLED_STATS:
+        rgbled_widget_log_stats();
+        break;
+    case RGBLED_BRIGHTNESS:
+        rgbled_widget_cycle_brightness();
+        break;
+    case RGBLED_TOGGLE:
+        rgbled_widget_toggle();
+        break;
+    default:
+        if (binding->param1 >= RGBLED_PATTERN(0)) {
+            rgbled_widget_show_pattern(binding->param1 - RGBLED_PATTERN(0), binding->param2);
+        }
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_RUNTIME_CONFIG)
+        // everything else is a config item
+        if (binding->param1 < RGBLED_BATTERY) {
+            rgbled_widget_config_set(binding->param1, binding->param2);
+        }
+#endif
+        break;
+    }
 #endif // IS_ENABLED(CONFIG_RGBLED_WIDGET)
 
     return ZMK_BEHAVIOR_OPAQUE;
@@ -54,18 +215,12 @@ static const struct behavior_driver_api behavior_rgb_wdg_driver_api = {
     .binding_released = on_keymap_binding_released,
     .locality = BEHAVIOR_LOCALITY_GLOBAL,
 #if IS_ENABLED(CONFIG_ZMK_BEHAVIOR_METADATA)
-    .get_parameter_metadata = zmk_behavior_get_empty_param_metadata,
+    .parameter_metadata = &metadata,
 #endif // IS_ENABLED(CONFIG_ZMK_BEHAVIOR_METADATA)
 };
 
 #define RGBIND_INST(n)                                                                             \
-    static struct behavior_rgb_wdg_config behavior_rgb_wdg_config_##n = {                          \
-        .indicate_battery = DT_INST_PROP(n, indicate_battery),                                     \
-        .indicate_connectivity = DT_INST_PROP(n, indicate_connectivity),                           \
-        .indicate_layer = DT_INST_PROP(n, indicate_layer),                                         \
-    };                                                                                             \
-    BEHAVIOR_DT_INST_DEFINE(n, behavior_rgb_wdg_init, NULL, NULL, &behavior_rgb_wdg_config_##n,    \
-                            POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT,                      \
-                            &behavior_rgb_wdg_driver_api);
+    BEHAVIOR_DT_INST_DEFINE(n, behavior_rgb_wdg_init, NULL, NULL, NULL, POST_KERNEL,               \
+                            CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_rgb_wdg_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(RGBIND_INST)
@@ -0,0 +1,43 @@
+#define DT_DRV_COMPAT zmk_behavior_rgbled_widget_layer_sync
+
+#include <zephyr/device.h>
+#include <drivers/behavior.h>
+#include <zephyr/logging/log.h>
+
+#include <zmk/behavior.h>
+
+#include <zmk_rgbled_widget/widget.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+// invoked by the central on peripherals with the highest active layer as the parameter, not
+// meant to be used in keymaps
+
+static int behavior_rgb_wdg_sync_init(const struct device *dev) { return 0; }
+
+static int on_keymap_binding_pressed(struct zmk_behavior_binding *binding,
+                                     struct zmk_behavior_binding_event event) {
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET)
+    update_relayed_layer(binding->param1);
+#endif
+
+    return ZMK_BEHAVIOR_OPAQUE;
+}
+
+static int on_keymap_binding_released(struct zmk_behavior_binding *binding,
+                                      struct zmk_behavior_binding_event event) {
+    return ZMK_BEHAVIOR_OPAQUE;
+}
+
+static const struct behavior_driver_api behavior_rgb_wdg_sync_driver_api = {
+    .binding_pressed = on_keymap_binding_pressed,
+    .binding_released = on_keymap_binding_released,
+    .locality = BEHAVIOR_LOCALITY_CENTRAL,
+};
+
+#define RGBSYNC_INST(n)                                                                            \
+    BEHAVIOR_DT_INST_DEFINE(n, behavior_rgb_wdg_sync_init, NULL, NULL, NULL, POST_KERNEL,          \
+                            CONFIG_KERNEL_INIT_PRIORITY_DEFAULT,                                   \
+                            &behavior_rgb_wdg_sync_driver_api);
+
+DT_INST_FOREACH_STATUS_OKAY(RGBSYNC_INST)
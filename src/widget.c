@@ -1,8 +1,16 @@
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/led.h>
+#include <zephyr/drivers/led_strip.h>
 #include <zephyr/init.h>
 #include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+
+#include <stdlib.h>
+#include <string.h>
 
 #include <zmk/battery.h>
 #include <zmk/ble.h>
@@ -20,11 +28,74 @@
 
 #include <zephyr/logging/log.h>
 
+#include <dt-bindings/zmk/rgbled_widget.h>
 #include <zmk_rgbled_widget/widget.h>
 
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STRIP_STRINGS)
+// compile out all log calls, so that their format strings and color names are not linked
+LOG_MODULE_DECLARE(zmk, LOG_LEVEL_NONE);
+#else
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+#endif
+
+// use an addressable LED strip instead of separate LEDs if a zmk,rgbled-widget-strip node exists
+#define LED_STRIP DT_HAS_COMPAT_STATUS_OKAY(zmk_rgbled_widget_strip)
+
+#if LED_STRIP
+#define STRIP_NODE_ID DT_COMPAT_GET_ANY_STATUS_OKAY(zmk_rgbled_widget_strip)
+#define STRIP_DEV_NODE_ID DT_PHANDLE(STRIP_NODE_ID, led_strip)
+#define STRIP_LEN DT_PROP(STRIP_DEV_NODE_ID, chain_length)
+
+// pixels for the sequenced indicators and the statuses shown in parallel, -1 if not shown
+#define INDICATOR_PIXEL DT_PROP_OR(STRIP_NODE_ID, indicator_pixel, -1)
+#define CONN_PIXEL DT_PROP_OR(STRIP_NODE_ID, connectivity_pixel, -1)
+#define LAYER_PIXEL DT_PROP_OR(STRIP_NODE_ID, layer_pixel, -1)
+
+BUILD_ASSERT(INDICATOR_PIXEL < STRIP_LEN && CONN_PIXEL < STRIP_LEN && LAYER_PIXEL < STRIP_LEN,
+             "RGBLED_WIDGET strip pixels must be smaller than the chain-length of the strip");
+
+BUILD_ASSERT(!DT_HAS_COMPAT_STATUS_OKAY(zmk_rgbled_widget_groups),
+             "RGBLED_WIDGET LED groups cannot be used together with an LED strip");
+
+#define LED_PWM 0
+#define LED_GROUP_NUM 1
+#else
+#define INDICATOR_PIXEL -1
+#define CONN_PIXEL -1
+#define LAYER_PIXEL -1
 
-#define LED_GPIO_NODE_ID DT_COMPAT_GET_ANY_STATUS_OKAY(gpio_leds)
+// use multiple independent groups of red/green/blue LEDs if a zmk,rgbled-widget-groups node exists
+#define LED_GROUPS DT_HAS_COMPAT_STATUS_OKAY(zmk_rgbled_widget_groups)
+
+#if LED_GROUPS
+#define GROUPS_NODE_ID DT_COMPAT_GET_ANY_STATUS_OKAY(zmk_rgbled_widget_groups)
+#define LED_GROUP_NUM DT_CHILD_NUM_STATUS_OKAY(GROUPS_NODE_ID)
+
+// red, green or blue LED of a group, and the LED controller node that contains it
+#define GROUP_LED(node_id, idx) DT_PHANDLE_BY_IDX(node_id, leds, idx)
+#define GROUP_LED_NODE_ID(node_id) DT_PARENT(GROUP_LED(node_id, 0))
+
+#define GROUP_IS_PWM(node_id) DT_NODE_HAS_COMPAT(GROUP_LED_NODE_ID(node_id), pwm_leds)
+#define GROUP_IS_SAME_NODE(node_id)                                                                \
+    (DT_SAME_NODE(DT_PARENT(GROUP_LED(node_id, 1)), GROUP_LED_NODE_ID(node_id)) &&                \
+     DT_SAME_NODE(DT_PARENT(GROUP_LED(node_id, 2)), GROUP_LED_NODE_ID(node_id)))
+
+// use the PWM backend with brightness control if all groups are defined under pwm-leds
+#define LED_PWM (DT_FOREACH_CHILD_STATUS_OKAY_SEP(GROUPS_NODE_ID, GROUP_IS_PWM, (&&)))
+
+BUILD_ASSERT(LED_PWM || !(DT_FOREACH_CHILD_STATUS_OKAY_SEP(GROUPS_NODE_ID, GROUP_IS_PWM, (||))),
+             "RGBLED_WIDGET LED groups must either all be under pwm-leds nodes or none of them");
+BUILD_ASSERT(DT_FOREACH_CHILD_STATUS_OKAY_SEP(GROUPS_NODE_ID, GROUP_IS_SAME_NODE, (&&)),
+             "The red, green and blue LEDs of each group must be defined under the same LED node "
+             "for RGBLED_WIDGET");
+#else
+#define LED_GROUP_NUM 1
+
+// LED controller node that contains the red/green/blue LEDs, either gpio-leds or pwm-leds
+#define LED_NODE_ID DT_PARENT(DT_ALIAS(led_red))
+
+// use the PWM backend with brightness control if the LEDs are defined under pwm-leds
+#define LED_PWM DT_NODE_HAS_COMPAT(LED_NODE_ID, pwm_leds)
 
 BUILD_ASSERT(DT_NODE_EXISTS(DT_ALIAS(led_red)),
              "An alias for a red LED is not found for RGBLED_WIDGET");
@@ -32,396 +103,2568 @@ BUILD_ASSERT(DT_NODE_EXISTS(DT_ALIAS(led_green)),
              "An alias for a green LED is not found for RGBLED_WIDGET");
 BUILD_ASSERT(DT_NODE_EXISTS(DT_ALIAS(led_blue)),
              "An alias for a blue LED is not found for RGBLED_WIDGET");
+BUILD_ASSERT(DT_SAME_NODE(DT_PARENT(DT_ALIAS(led_green)), LED_NODE_ID) &&
+                 DT_SAME_NODE(DT_PARENT(DT_ALIAS(led_blue)), LED_NODE_ID),
+             "The red, green and blue LEDs must be defined under the same LED node for "
+             "RGBLED_WIDGET");
+#endif // LED_GROUPS
+#endif // LED_STRIP
+
+BUILD_ASSERT(!IS_ENABLED(CONFIG_RGBLED_WIDGET_ANIMATION) || LED_PWM,
+             "CONFIG_RGBLED_WIDGET_ANIMATION requires the LEDs to be defined under a pwm-leds node");
+BUILD_ASSERT(!IS_ENABLED(CONFIG_RGBLED_WIDGET_ANIMATION) || LED_GROUP_NUM == 1,
+             "CONFIG_RGBLED_WIDGET_ANIMATION only supports a single LED group");
+
+// drive gpio-leds directly through their GPIOs, instead of one LED API call per channel
+#define LED_GPIO_PORT (IS_ENABLED(CONFIG_RGBLED_WIDGET_GPIO_PORT) && !LED_PWM && !LED_STRIP)
+
+BUILD_ASSERT(!IS_ENABLED(CONFIG_RGBLED_WIDGET_GPIO_PORT) || LED_GPIO_PORT,
+             "CONFIG_RGBLED_WIDGET_GPIO_PORT requires the LEDs to be defined under a gpio-leds node");
 
 BUILD_ASSERT(!(SHOW_LAYER_CHANGE && SHOW_LAYER_COLORS),
              "CONFIG_RGBLED_WIDGET_SHOW_LAYER_CHANGE and CONFIG_RGBLED_WIDGET_SHOW_LAYER_COLORS "
              "are mutually exclusive");
 
-// GPIO-based LED device and indices of red/green/blue LEDs inside its DT node
-static const struct device *led_dev = DEVICE_DT_GET(LED_GPIO_NODE_ID);
-static const uint8_t rgb_idx[] = {DT_NODE_CHILD_IDX(DT_ALIAS(led_red)),
-                                  DT_NODE_CHILD_IDX(DT_ALIAS(led_green)),
-                                  DT_NODE_CHILD_IDX(DT_ALIAS(led_blue))};
+#if LED_STRIP
+static const struct device *strip_dev = DEVICE_DT_GET(STRIP_DEV_NODE_ID);
+#endif
 
 // map from color values to names, for logging
 static const char *color_names[] = {"black", "red",     "green", "yellow",
                                     "blue",  "magenta", "cyan",  "white"};
 
-#if SHOW_LAYER_COLORS
-static const uint8_t layer_color_idx[] = {
-    CONFIG_RGBLED_WIDGET_LAYER_0_COLOR,  CONFIG_RGBLED_WIDGET_LAYER_1_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_2_COLOR,  CONFIG_RGBLED_WIDGET_LAYER_3_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_4_COLOR,  CONFIG_RGBLED_WIDGET_LAYER_5_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_6_COLOR,  CONFIG_RGBLED_WIDGET_LAYER_7_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_8_COLOR,  CONFIG_RGBLED_WIDGET_LAYER_9_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_10_COLOR, CONFIG_RGBLED_WIDGET_LAYER_11_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_12_COLOR, CONFIG_RGBLED_WIDGET_LAYER_13_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_14_COLOR, CONFIG_RGBLED_WIDGET_LAYER_15_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_16_COLOR, CONFIG_RGBLED_WIDGET_LAYER_17_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_18_COLOR, CONFIG_RGBLED_WIDGET_LAYER_19_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_20_COLOR, CONFIG_RGBLED_WIDGET_LAYER_21_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_22_COLOR, CONFIG_RGBLED_WIDGET_LAYER_23_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_24_COLOR, CONFIG_RGBLED_WIDGET_LAYER_25_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_26_COLOR, CONFIG_RGBLED_WIDGET_LAYER_27_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_28_COLOR, CONFIG_RGBLED_WIDGET_LAYER_29_COLOR,
-    CONFIG_RGBLED_WIDGET_LAYER_30_COLOR, CONFIG_RGBLED_WIDGET_LAYER_31_COLOR,
-};
+// one layer color per keymap layer instead of one for each of the 32 layers ZMK supports, using
+// the child count of the keymap node since LISTIFY needs a literal
+#define LED_LAYERS_LEN DT_CHILD_NUM(DT_INST(0, zmk_keymap))
+#define LED_LAYER_COLOR_DEFAULT(i, _) UTIL_CAT(UTIL_CAT(CONFIG_RGBLED_WIDGET_LAYER_, i), _COLOR)
+
+BUILD_ASSERT(LED_LAYERS_LEN == ZMK_KEYMAP_LAYERS_LEN && LED_LAYERS_LEN <= 32,
+             "Unexpected number of keymap layers for RGBLED_WIDGET layer colors");
+
+// colors, thresholds and durations, which can be changed at runtime with the &rgbled_widget
+// behavior if enabled and are otherwise constant
+struct led_config {
+    uint16_t interval_ms;
+    uint16_t battery_blink_ms;
+    uint16_t conn_blink_ms;
+    uint16_t layer_blink_ms;
+    uint8_t battery_level_high;
+    uint8_t battery_level_low;
+    uint8_t battery_level_critical;
+    uint8_t battery_color_high;
+    uint8_t battery_color_medium;
+    uint8_t battery_color_low;
+    uint8_t battery_color_critical;
+    uint8_t battery_color_missing;
+    uint8_t conn_color_connected;
+    uint8_t conn_color_advertising;
+    uint8_t conn_color_disconnected;
+    uint8_t conn_color_usb;
+    uint8_t layer_color;
+    uint8_t layer_colors[LED_LAYERS_LEN];
+} __packed;
+
+#define LED_CONFIG_DEFAULTS                                                                        \
+    {                                                                                              \
+        .interval_ms = CONFIG_RGBLED_WIDGET_INTERVAL_MS,                                           \
+        .battery_blink_ms = CONFIG_RGBLED_WIDGET_BATTERY_BLINK_MS,                                 \
+        .conn_blink_ms = CONFIG_RGBLED_WIDGET_CONN_BLINK_MS,                                       \
+        .layer_blink_ms = CONFIG_RGBLED_WIDGET_LAYER_BLINK_MS,                                     \
+        .battery_level_high = CONFIG_RGBLED_WIDGET_BATTERY_LEVEL_HIGH,                             \
+        .battery_level_low = CONFIG_RGBLED_WIDGET_BATTERY_LEVEL_LOW,                               \
+        .battery_level_critical = CONFIG_RGBLED_WIDGET_BATTERY_LEVEL_CRITICAL,                     \
+        .battery_color_high = CONFIG_RGBLED_WIDGET_BATTERY_COLOR_HIGH,                             \
+        .battery_color_medium = CONFIG_RGBLED_WIDGET_BATTERY_COLOR_MEDIUM,                         \
+        .battery_color_low = CONFIG_RGBLED_WIDGET_BATTERY_COLOR_LOW,                               \
+        .battery_color_critical = CONFIG_RGBLED_WIDGET_BATTERY_COLOR_CRITICAL,                     \
+        .battery_color_missing = CONFIG_RGBLED_WIDGET_BATTERY_COLOR_MISSING,                       \
+        .conn_color_connected = CONFIG_RGBLED_WIDGET_CONN_COLOR_CONNECTED,                         \
+        .conn_color_advertising = CONFIG_RGBLED_WIDGET_CONN_COLOR_ADVERTISING,                     \
+        .conn_color_disconnected = CONFIG_RGBLED_WIDGET_CONN_COLOR_DISCONNECTED,                   \
+        .conn_color_usb = CONFIG_RGBLED_WIDGET_CONN_COLOR_USB,                                     \
+        .layer_color = CONFIG_RGBLED_WIDGET_LAYER_COLOR,                                           \
+        .layer_colors = {LISTIFY(LED_LAYERS_LEN, LED_LAYER_COLOR_DEFAULT, (, ))},                  \
+    }
+
+BUILD_ASSERT(CONFIG_RGBLED_WIDGET_INTERVAL_MS <= RGBLED_CFG_MS_MAX &&
+                 CONFIG_RGBLED_WIDGET_BATTERY_BLINK_MS <= RGBLED_CFG_MS_MAX &&
+                 CONFIG_RGBLED_WIDGET_CONN_BLINK_MS <= RGBLED_CFG_MS_MAX &&
+                 CONFIG_RGBLED_WIDGET_LAYER_BLINK_MS <= RGBLED_CFG_MS_MAX,
+             "Blink and interval durations must be at most 65533 ms");
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_RUNTIME_CONFIG)
+static struct led_config led_config = LED_CONFIG_DEFAULTS;
+#else
+static const struct led_config led_config = LED_CONFIG_DEFAULTS;
 #endif
 
 // log shorthands
 #define LOG_CONN_CENTRAL(index, status, color_label)                                               \
     LOG_INF("Profile %d %s, blinking %s", index, status,                                           \
-            color_names[CONFIG_RGBLED_WIDGET_CONN_COLOR_##color_label])
+            color_names[led_config.conn_color_##color_label])
 #define LOG_CONN_PERIPHERAL(status, color_label)                                                   \
     LOG_INF("Peripheral %s, blinking %s", status,                                                  \
-            color_names[CONFIG_RGBLED_WIDGET_CONN_COLOR_##color_label])
+            color_names[led_config.conn_color_##color_label])
 #define LOG_BATTERY(battery_level, color_label)                                                    \
     LOG_INF("Battery level %d, blinking %s", battery_level,                                        \
-            color_names[CONFIG_RGBLED_WIDGET_BATTERY_COLOR_##color_label])
+            color_names[led_config.battery_color_##color_label])
 
-// a blink work item as specified by the color and duration
-struct blink_item {
-    uint8_t color;
-    uint32_t duration_ms;
-    uint32_t sleep_ms;
+// priority classes of blink items, higher values are shown first
+enum led_priority {
+    LED_PRIO_LAYER,
+    LED_PRIO_BATTERY,
+    LED_PRIO_CONNECTIVITY,
+    LED_PRIO_CRITICAL,
+    LED_PRIO_COUNT,
 };
 
-// flag to indicate whether the initial boot up sequence is complete
-static bool initialized = false;
+// blink patterns are constant step tables of <color on-ms off-ms repeat> words, each showing the
+// color for on-ms and then the rest color for off-ms, repeat times; RGBLED_ARG and RGBLED_MS_*
+// values are resolved from the queued item and the config when the step is shown
+#define LED_PATTERN_STEP_WORDS 4
+
+struct led_pattern {
+    const uint16_t *steps;
+    uint8_t num_steps;
+    uint8_t priority;
+};
 
-// track current color for persistent indicators (layer color)
-uint8_t led_current_color = 0;
+// built-in patterns, followed by the ones from the zmk,rgbled-widget-patterns node
+enum led_pattern_id {
+    // persistent layer color, only changing the color the LEDs return to after blinks
+    LED_PATTERN_LAYER_COLOR,
+    // a single blink followed by the interval
+    LED_PATTERN_BLINK,
+    // a single blink followed by another blink duration, for all but the last layer digit
+    LED_PATTERN_DIGIT,
+    // `count` blinks separated by the blink duration, then a last one followed by the interval
+    LED_PATTERN_LAYER_COUNT,
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_RUNTIME_EXTRA_BLINK)
+    // a blink for the estimated battery time remaining
+    LED_PATTERN_BATTERY_RUNTIME,
+#endif
+    LED_PATTERN_CUSTOM,
+};
 
-// low-level method to control the LED
-static void set_rgb_leds(uint8_t color, uint32_t duration_ms) {
-    for (uint8_t pos = 0; pos < 3; pos++) {
-        uint8_t bit = BIT(pos);
-        if ((bit & led_current_color) != (bit & color)) {
-            // bits are different, so we need to change one
-            if (bit & color) {
-                led_on(led_dev, rgb_idx[pos]);
-            } else {
-                led_off(led_dev, rgb_idx[pos]);
-            }
-        }
-    }
-    if (duration_ms > 0) {
-        k_sleep(K_MSEC(duration_ms));
-    }
-    led_current_color = color;
-}
+static const uint16_t led_pattern_layer_color[] = {RGBLED_ARG, 0, 0, 1};
+static const uint16_t led_pattern_blink[] = {RGBLED_ARG, RGBLED_MS_BLINK, RGBLED_MS_INTERVAL, 1};
+static const uint16_t led_pattern_digit[] = {RGBLED_ARG, RGBLED_MS_BLINK, RGBLED_MS_BLINK, 1};
+static const uint16_t led_pattern_layer_count[] = {
+    RGBLED_ARG, RGBLED_MS_BLINK, RGBLED_MS_BLINK,    RGBLED_ARG,
+    RGBLED_ARG, RGBLED_MS_BLINK, RGBLED_MS_INTERVAL, 1,
+};
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_RUNTIME_EXTRA_BLINK)
+static const uint16_t led_pattern_battery_runtime[] = {
+    RGBLED_ARG, CONFIG_RGBLED_WIDGET_BATTERY_RUNTIME_BLINK_MS, RGBLED_MS_INTERVAL, 1};
+#endif
 
-// define message queue of blink work items, that will be processed by a
-// separate thread
-K_MSGQ_DEFINE(led_msgq, sizeof(struct blink_item), 16, 1);
+#define LED_PATTERN(code, prio)                                                                    \
+    {.steps = code, .num_steps = ARRAY_SIZE(code) / LED_PATTERN_STEP_WORDS, .priority = prio}
 
-static void indicate_connectivity_internal(void) {
-    struct blink_item blink = {.duration_ms = CONFIG_RGBLED_WIDGET_CONN_BLINK_MS};
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_rgbled_widget_patterns)
+#define PATTERNS_NODE_ID DT_COMPAT_GET_ANY_STATUS_OKAY(zmk_rgbled_widget_patterns)
+#define LED_PATTERN_CUSTOM_NUM DT_CHILD_NUM_STATUS_OKAY(PATTERNS_NODE_ID)
 
-#if !IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL)
-#if IS_ENABLED(CONFIG_ZMK_BLE)
-    uint8_t profile_index = zmk_ble_active_profile_index();
-#endif
+// colors and repeat counts must fit the fields they are shown with, durations 16 bits
+#define PATTERN_WORD_VALID(word, value)                                                            \
+    ((value) == RGBLED_ARG || ((word) == 0   ? (value) <= RGBLED_WHITE                             \
+                               : (word) == 3 ? (value) <= UINT8_MAX                                \
+                                             : (value) <= UINT16_MAX))
 
-    switch (zmk_endpoint_get_selected().transport) {
-    case ZMK_TRANSPORT_USB: // USB connected and selected
-#if IS_ENABLED(CONFIG_RGBLED_WIDGET_CONN_SHOW_USB)
-        LOG_INF("USB connected, blinking %s", color_names[CONFIG_RGBLED_WIDGET_CONN_COLOR_USB]);
-        blink.color = CONFIG_RGBLED_WIDGET_CONN_COLOR_USB;
-        break;
+#define PATTERN_STEP_CHECK(node_id, prop, idx)                                                     \
+    BUILD_ASSERT(PATTERN_WORD_VALID((idx) % LED_PATTERN_STEP_WORDS,                                \
+                                    DT_PROP_BY_IDX(node_id, prop, idx)),                           \
+                 "RGBLED_WIDGET pattern step out of range, colors must be up to 7, repeat "        \
+                 "counts up to 255 and durations up to 65535");
+
+#define PATTERN_CODE(node_id)                                                                      \
+    BUILD_ASSERT(DT_PROP_LEN(node_id, steps) % LED_PATTERN_STEP_WORDS == 0,                        \
+                 "RGBLED_WIDGET pattern steps must be groups of <color on-ms off-ms repeat>");     \
+    DT_FOREACH_PROP_ELEM(node_id, steps, PATTERN_STEP_CHECK)                                       \
+    static const uint16_t led_pattern_##node_id[] = {                                              \
+        DT_FOREACH_PROP_ELEM_SEP(node_id, steps, DT_PROP_BY_IDX, (, ))};
+
+DT_FOREACH_CHILD_STATUS_OKAY(PATTERNS_NODE_ID, PATTERN_CODE)
+
+// the priority enum lists the classes in the same order as enum led_priority
+#define PATTERN_INIT(node_id)                                                                      \
+    LED_PATTERN(led_pattern_##node_id, DT_ENUM_IDX(node_id, priority)),
+#else
+#define LED_PATTERN_CUSTOM_NUM 0
 #endif
-    case ZMK_TRANSPORT_BLE: // BLE connected and selected
-#if IS_ENABLED(CONFIG_ZMK_BLE)
-        LOG_CONN_CENTRAL(profile_index, "connected", CONNECTED);
-        blink.color = CONFIG_RGBLED_WIDGET_CONN_COLOR_CONNECTED;
-        break;
+
+static const struct led_pattern led_patterns[] = {
+    [LED_PATTERN_LAYER_COLOR] = LED_PATTERN(led_pattern_layer_color, LED_PRIO_LAYER),
+    [LED_PATTERN_BLINK] = LED_PATTERN(led_pattern_blink, LED_PRIO_LAYER),
+    [LED_PATTERN_DIGIT] = LED_PATTERN(led_pattern_digit, LED_PRIO_LAYER),
+    [LED_PATTERN_LAYER_COUNT] = LED_PATTERN(led_pattern_layer_count, LED_PRIO_LAYER),
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_RUNTIME_EXTRA_BLINK)
+    [LED_PATTERN_BATTERY_RUNTIME] = LED_PATTERN(led_pattern_battery_runtime, LED_PRIO_BATTERY),
 #endif
-    default: // ZMK_TRANSPORT_NONE, neither BLE nor USB connected
-#if IS_ENABLED(CONFIG_ZMK_BLE)
-        if (zmk_endpoint_get_preferred_transport() != ZMK_TRANSPORT_NONE &&
-            zmk_ble_active_profile_is_open()) {
-            LOG_CONN_CENTRAL(profile_index, "open", ADVERTISING);
-            blink.color = CONFIG_RGBLED_WIDGET_CONN_COLOR_ADVERTISING;
-            break;
-        }
+#if LED_PATTERN_CUSTOM_NUM > 0
+    DT_FOREACH_CHILD_STATUS_OKAY(PATTERNS_NODE_ID, PATTERN_INIT)
 #endif
-        LOG_CONN_CENTRAL(-1, "no endpoints connected", DISCONNECTED);
-        blink.color = CONFIG_RGBLED_WIDGET_CONN_COLOR_DISCONNECTED;
-        break;
-    }
-#elif IS_ENABLED(CONFIG_ZMK_SPLIT_BLE)
-    if (zmk_split_bt_peripheral_is_connected()) {
-        LOG_CONN_PERIPHERAL("connected", CONNECTED);
-        blink.color = CONFIG_RGBLED_WIDGET_CONN_COLOR_CONNECTED;
-    } else {
-        LOG_CONN_PERIPHERAL("not connected", DISCONNECTED);
-        blink.color = CONFIG_RGBLED_WIDGET_CONN_COLOR_DISCONNECTED;
-    }
+};
+
+BUILD_ASSERT(ARRAY_SIZE(led_patterns) <= UINT8_MAX, "Too many RGBLED_WIDGET patterns");
+
+// the argument of a blink item holds the color and count used by RGBLED_ARG steps
+#define BLINK_ARG(color, count) RGBLED_PATTERN_ARG(color, count)
+#define BLINK_ARG_COLOR(arg) ((arg) & 0x7)
+#define BLINK_ARG_COUNT(arg) ((arg) >> 3)
+
+// a blink work item showing a pattern with an argument, small enough to keep many of them queued
+struct blink_item {
+    uint8_t pattern;
+    uint8_t arg;
+    uint8_t priority : 7;
+    // requested with the behavior rather than triggered by an event
+    uint8_t requested : 1;
+    uint8_t generation;
+    // step in progress and its repetitions done, so that an item can continue after yielding
+    uint8_t step;
+    uint8_t done;
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+    // uptime when the item was queued, cleared once its latency is recorded
+    uint32_t queued_ms;
 #endif
+};
 
-    k_msgq_put(&led_msgq, &blink, K_NO_WAIT);
+// words of the step an item is at
+static inline const uint16_t *blink_item_step(const struct blink_item *blink) {
+    return &led_patterns[blink->pattern].steps[blink->step * LED_PATTERN_STEP_WORDS];
 }
 
-static int led_output_listener_cb(const zmk_event_t *eh) {
-    if (initialized) {
-        indicate_connectivity();
+static inline bool blink_item_is_persistent(const struct blink_item *blink) {
+    return blink->pattern == LED_PATTERN_LAYER_COLOR;
+}
+
+static uint8_t blink_item_color(const struct blink_item *blink) {
+    uint16_t color = blink_item_step(blink)[0];
+    return color == RGBLED_ARG ? BLINK_ARG_COLOR(blink->arg) : color & 0x7;
+}
+
+static uint8_t blink_item_repeat(const struct blink_item *blink) {
+    uint16_t repeat = blink_item_step(blink)[3];
+    return repeat == RGBLED_ARG ? BLINK_ARG_COUNT(blink->arg) : repeat;
+}
+
+// resolve a step duration, which can refer to the configured durations
+static uint32_t blink_item_ms(const struct blink_item *blink, uint16_t ms) {
+    switch (ms) {
+    case RGBLED_MS_INTERVAL:
+        return led_config.interval_ms;
+    case RGBLED_MS_BLINK:
+        switch (blink->priority) {
+        case LED_PRIO_LAYER:
+            return led_config.layer_blink_ms;
+        case LED_PRIO_CONNECTIVITY:
+            return led_config.conn_blink_ms;
+        default:
+            return led_config.battery_blink_ms;
+        }
+    default:
+        return ms;
     }
-    return 0;
 }
 
-// debouncing to ignore all but last connectivity event, to prevent repeat blinks
-static struct k_work_delayable indicate_connectivity_work;
-static void indicate_connectivity_cb(struct k_work *work) { indicate_connectivity_internal(); }
-void indicate_connectivity() { k_work_reschedule(&indicate_connectivity_work, K_MSEC(16)); }
+#define blink_item_on_ms(blink) blink_item_ms(blink, blink_item_step(blink)[1])
+#define blink_item_off_ms(blink) blink_item_ms(blink, blink_item_step(blink)[2])
 
-ZMK_LISTENER(led_output_listener, led_output_listener_cb);
+// flag to indicate whether the initial boot up sequence is complete
+static bool initialized = false;
 
-#if !IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL)
-// run led_output_listener_cb on endpoint and BLE profile change (on central)
-#if IS_ENABLED(CONFIG_RGBLED_WIDGET_CONN_SHOW_USB)
-ZMK_SUBSCRIPTION(led_output_listener, zmk_endpoint_changed);
+// last activity state, used to dim persistent colors when idle and stop indicating when asleep
+static enum zmk_activity_state led_activity_state = ZMK_ACTIVITY_ACTIVE;
+
+// indicators turned off with the toggle action of the behavior, treated like sleep
+static bool led_disabled = false;
+
+#if LED_PWM || LED_STRIP
+// brightness percentage applied on top of the configured ones, set with the brightness action
+static uint8_t led_brightness_level = 100;
 #endif
-#if IS_ENABLED(CONFIG_ZMK_BLE)
-ZMK_SUBSCRIPTION(led_output_listener, zmk_ble_active_profile_changed);
-#endif // IS_ENABLED(CONFIG_ZMK_BLE)
-#elif IS_ENABLED(CONFIG_ZMK_SPLIT_BLE)
-// run led_output_listener_cb on peripheral status change event
-ZMK_SUBSCRIPTION(led_output_listener, zmk_split_peripheral_status_changed);
+
+// a group of red/green/blue LEDs, with its own queue and sequencer so that indicators on
+// different groups do not wait for each other
+struct led_group {
+#if !LED_STRIP
+    // GPIO or PWM-based LED device and indices of red/green/blue LEDs inside its DT node
+    const struct device *dev;
+    uint8_t rgb_idx[3];
 #endif
+#if LED_GPIO_PORT
+    // GPIOs of the red/green/blue LEDs, and their pins if they share a port, otherwise 0
+    struct gpio_dt_spec gpios[3];
+    gpio_port_pins_t port_pins;
+#endif
+    // bit mask of the priority classes shown on the group, unassigned ones use the first group
+    uint8_t priorities;
 
-#if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
-static inline uint8_t get_battery_color(uint8_t battery_level) {
-    if (battery_level == 0) {
-        LOG_INF("Battery level undetermined (zero), blinking %s",
-                color_names[CONFIG_RGBLED_WIDGET_BATTERY_COLOR_MISSING]);
-        return CONFIG_RGBLED_WIDGET_BATTERY_COLOR_MISSING;
-    }
-    if (battery_level >= CONFIG_RGBLED_WIDGET_BATTERY_LEVEL_HIGH) {
-        LOG_BATTERY(battery_level, HIGH);
-        return CONFIG_RGBLED_WIDGET_BATTERY_COLOR_HIGH;
-    }
-    if (battery_level >= CONFIG_RGBLED_WIDGET_BATTERY_LEVEL_LOW) {
-        LOG_BATTERY(battery_level, MEDIUM);
-        return CONFIG_RGBLED_WIDGET_BATTERY_COLOR_MEDIUM;
-    }
-    LOG_BATTERY(battery_level, LOW);
-    return CONFIG_RGBLED_WIDGET_BATTERY_COLOR_LOW;
-}
+    // track current color and brightness, to only change the LEDs that need it
+    uint8_t current_color;
+    uint8_t current_brightness;
 
-void indicate_battery(void) {
-    struct blink_item blink = {.duration_ms = CONFIG_RGBLED_WIDGET_BATTERY_BLINK_MS};
-    int retry = 0;
+    // fixed capacity queue of blink work items that will be processed by the sequencer, kept in
+    // insertion order and served highest priority first
+    struct blink_item queue[CONFIG_RGBLED_WIDGET_QUEUE_SIZE];
+    uint8_t queue_len;
+    struct k_spinlock queue_lock;
 
-#if IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_SHOW_SELF) ||                                          \
-    IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_SHOW_PERIPHERALS)
-    uint8_t battery_level = zmk_battery_state_of_charge();
-    while (battery_level == 0 && retry++ < 10) {
-        k_sleep(K_MSEC(100));
-        battery_level = zmk_battery_state_of_charge();
-    };
+    // current sequence generation per priority, pending items from older generations are stale
+    uint8_t generation[LED_PRIO_COUNT];
+
+    // number of items dropped due to the queue being full
+    uint32_t overflows;
+
+    // sequencer state for the blink item currently being shown
+    struct blink_item seq_item;
+    uint8_t seq_step;
+    bool seq_active;
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_SEQUENCER_THREAD)
+    struct k_sem queue_sem;
+    k_tid_t tid;
+#elif IS_ENABLED(CONFIG_RGBLED_WIDGET_SEQUENCER_WORKQUEUE)
+    struct k_work_delayable seq_work;
 
-    blink.color = get_battery_color(battery_level);
-    k_msgq_put(&led_msgq, &blink, K_NO_WAIT);
+    // uptime in ms until which the current LED state should be held
+    int64_t seq_deadline;
 #endif
+};
 
-#if IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_SHOW_PERIPHERALS) ||                                   \
-    IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_SHOW_ONLY_PERIPHERALS)
-    for (uint8_t i = 0; i < ZMK_SPLIT_BLE_PERIPHERAL_COUNT; i++) {
-        uint8_t peripheral_level;
-        int ret = zmk_split_central_get_peripheral_battery_level(i, &peripheral_level);
-        if (ret == 0) {
-            retry = 0;
-            while (peripheral_level == 0 && retry++ < (CONFIG_RGBLED_WIDGET_BATTERY_BLINK_MS +
-                                                       CONFIG_RGBLED_WIDGET_INTERVAL_MS) /
-                                                          100) {
-                k_sleep(K_MSEC(100));
-                zmk_split_central_get_peripheral_battery_level(i, &peripheral_level);
-            }
+#define ALL_PRIORITIES (BIT(LED_PRIO_COUNT) - 1)
 
-            LOG_INF("Got battery level for peripheral %d:", i);
-            blink.color = get_battery_color(peripheral_level);
-            k_msgq_put(&led_msgq, &blink, K_NO_WAIT);
-        } else {
-            LOG_ERR("Error looking up battery level for peripheral %d", i);
-        }
-    }
+#if LED_GPIO_PORT
+#define LED_GPIO_SAME_PORT(red, green, blue)                                                       \
+    (DT_SAME_NODE(DT_GPIO_CTLR(red, gpios), DT_GPIO_CTLR(green, gpios)) &&                         \
+     DT_SAME_NODE(DT_GPIO_CTLR(red, gpios), DT_GPIO_CTLR(blue, gpios)))
+
+// resolved at build time, so that a color change needs no lookups
+#define LED_GPIO_INIT(red, green, blue)                                                            \
+    .gpios = {GPIO_DT_SPEC_GET(red, gpios), GPIO_DT_SPEC_GET(green, gpios),                        \
+              GPIO_DT_SPEC_GET(blue, gpios)},                                                      \
+    .port_pins = LED_GPIO_SAME_PORT(red, green, blue)                                              \
+                     ? BIT(DT_GPIO_PIN(red, gpios)) | BIT(DT_GPIO_PIN(green, gpios)) |             \
+                           BIT(DT_GPIO_PIN(blue, gpios))                                           \
+                     : 0,
+#else
+#define LED_GPIO_INIT(red, green, blue)
 #endif
-}
 
-static int led_battery_listener_cb(const zmk_event_t *eh) {
-    if (!initialized) {
-        return 0;
-    }
+#if LED_STRIP
+// the strip has a single group, shown on the indicator pixel
+static struct led_group led_groups[] = {{.priorities = ALL_PRIORITIES}};
+#elif LED_GROUPS
+#define GROUP_PRIORITIES(node_id)                                                                  \
+    ((DT_PROP(node_id, indicate_battery) ? BIT(LED_PRIO_BATTERY) | BIT(LED_PRIO_CRITICAL) : 0) |   \
+     (DT_PROP(node_id, indicate_connectivity) ? BIT(LED_PRIO_CONNECTIVITY) : 0) |                  \
+     (DT_PROP(node_id, indicate_layer) ? BIT(LED_PRIO_LAYER) : 0))
+
+#define GROUP_INIT(node_id)                                                                        \
+    {                                                                                              \
+        .dev = DEVICE_DT_GET(GROUP_LED_NODE_ID(node_id)),                                          \
+        .rgb_idx = {DT_NODE_CHILD_IDX(GROUP_LED(node_id, 0)),                                      \
+                    DT_NODE_CHILD_IDX(GROUP_LED(node_id, 1)),                                      \
+                    DT_NODE_CHILD_IDX(GROUP_LED(node_id, 2))},                                     \
+        .priorities = GROUP_PRIORITIES(node_id),                                                   \
+        LED_GPIO_INIT(GROUP_LED(node_id, 0), GROUP_LED(node_id, 1), GROUP_LED(node_id, 2))         \
+    },
 
-    // check if we are in critical battery levels at state change, blink if we are
-    uint8_t battery_level = as_zmk_battery_state_changed(eh)->state_of_charge;
+static struct led_group led_groups[] = {DT_FOREACH_CHILD_STATUS_OKAY(GROUPS_NODE_ID, GROUP_INIT)};
+#else
+static struct led_group led_groups[] = {{
+    .dev = DEVICE_DT_GET(LED_NODE_ID),
+    .rgb_idx = {DT_NODE_CHILD_IDX(DT_ALIAS(led_red)), DT_NODE_CHILD_IDX(DT_ALIAS(led_green)),
+                DT_NODE_CHILD_IDX(DT_ALIAS(led_blue))},
+    .priorities = ALL_PRIORITIES,
+    LED_GPIO_INIT(DT_ALIAS(led_red), DT_ALIAS(led_green), DT_ALIAS(led_blue))
+}};
+#endif
 
-    if (battery_level > 0 && battery_level <= CONFIG_RGBLED_WIDGET_BATTERY_LEVEL_CRITICAL) {
-        LOG_BATTERY(battery_level, CRITICAL);
+BUILD_ASSERT(ARRAY_SIZE(led_groups) == LED_GROUP_NUM);
 
-        struct blink_item blink = {.duration_ms = CONFIG_RGBLED_WIDGET_BATTERY_BLINK_MS,
-                                   .color = CONFIG_RGBLED_WIDGET_BATTERY_COLOR_CRITICAL};
-        k_msgq_put(&led_msgq, &blink, K_NO_WAIT);
+// the group that shows a priority class
+static struct led_group *led_group_for(enum led_priority priority) {
+    for (uint8_t i = 0; i < ARRAY_SIZE(led_groups); i++) {
+        if (led_groups[i].priorities & BIT(priority)) {
+            return &led_groups[i];
+        }
     }
-    return 0;
+    return &led_groups[0];
 }
 
-// run led_battery_listener_cb on battery state change event
-ZMK_LISTENER(led_battery_listener, led_battery_listener_cb);
-ZMK_SUBSCRIPTION(led_battery_listener, zmk_battery_state_changed);
-#endif // IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+static inline uint8_t led_group_index(const struct led_group *grp) { return grp - led_groups; }
 
-uint8_t led_layer_color = 0;
-#if SHOW_LAYER_COLORS
-void update_layer_color(void) {
-    uint8_t index = zmk_keymap_highest_layer_active();
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+// counters for checking whether indications were dropped or delayed
+static struct {
+    uint32_t queued[LED_PRIO_COUNT];
+    uint32_t superseded[LED_PRIO_COUNT];
+    uint32_t unchanged[LED_PRIO_COUNT];
+    uint32_t dropped[LED_PRIO_COUNT];
+    uint32_t latency_count[LED_PRIO_COUNT];
+    uint32_t latency_sum_ms[LED_PRIO_COUNT];
+    uint32_t latency_max_ms[LED_PRIO_COUNT];
+    uint64_t on_time_ms[3];
+    uint64_t charge_ua_ms[3];
+    uint32_t on_time_updated_ms[LED_GROUP_NUM];
+    uint8_t on_color[LED_GROUP_NUM];
+    uint8_t on_brightness[LED_GROUP_NUM];
+    uint8_t queue_high_water;
+    uint32_t relayed;
+    uint32_t anim_frames;
+    uint64_t anim_frame_cycles;
+    uint32_t anim_frame_cycles_max;
+} led_stats;
+static struct k_spinlock led_stats_lock;
 
-    if (led_layer_color != layer_color_idx[index]) {
-        led_layer_color = layer_color_idx[index];
-        struct blink_item color = {.color = led_layer_color};
-        LOG_INF("Setting layer color to %s for layer %d", color_names[led_layer_color], index);
-        k_msgq_put(&led_msgq, &color, K_NO_WAIT);
-    }
-}
+#define LED_STATS_INC(field, priority)                                                             \
+    K_SPINLOCK(&led_stats_lock) { led_stats.field[priority]++; }
 
-static int led_layer_color_listener_cb(const zmk_event_t *eh) {
-    struct zmk_activity_state_changed *ev = as_zmk_activity_state_changed(eh);
-
-    // check if this is indeed an activity state changed event
-    if (ev != NULL) {
-        switch (ev->state) {
-        case ZMK_ACTIVITY_SLEEP:
-            LOG_INF("Detected sleep activity state, turn off LED");
-            set_rgb_leds(0, 0);
-            break;
-        default: // not handling IDLE and ACTIVE yet
-            break;
+void rgbled_widget_get_stats(struct rgbled_widget_stats *stats) {
+    K_SPINLOCK(&led_stats_lock) {
+        *stats = (struct rgbled_widget_stats){.queue_high_water = led_stats.queue_high_water,
+                                              .relayed = led_stats.relayed};
+        for (uint8_t prio = 0; prio < LED_PRIO_COUNT; prio++) {
+            stats->queued += led_stats.queued[prio];
+            stats->superseded += led_stats.superseded[prio];
+            stats->unchanged += led_stats.unchanged[prio];
+            stats->dropped += led_stats.dropped[prio];
         }
-        return 0;
     }
+}
 
-    // it must be a layer change event instead
-    if (initialized) {
-        update_layer_color();
+void rgbled_widget_reset_stats(void) {
+    // the LED on times are kept, as they are tracked across LED updates
+    K_SPINLOCK(&led_stats_lock) {
+        memset(led_stats.queued, 0, sizeof(led_stats.queued));
+        memset(led_stats.superseded, 0, sizeof(led_stats.superseded));
+        memset(led_stats.unchanged, 0, sizeof(led_stats.unchanged));
+        memset(led_stats.dropped, 0, sizeof(led_stats.dropped));
+        memset(led_stats.latency_count, 0, sizeof(led_stats.latency_count));
+        memset(led_stats.latency_sum_ms, 0, sizeof(led_stats.latency_sum_ms));
+        memset(led_stats.latency_max_ms, 0, sizeof(led_stats.latency_max_ms));
+        led_stats.queue_high_water = 0;
+        led_stats.relayed = 0;
+        led_stats.anim_frames = 0;
+        led_stats.anim_frame_cycles = 0;
+        led_stats.anim_frame_cycles_max = 0;
     }
-    return 0;
 }
+#else
+#define LED_STATS_INC(field, priority)
+#endif
 
-// run layer_color_listener_cb on layer status change event and activity state event
-ZMK_LISTENER(led_layer_color_listener, led_layer_color_listener_cb);
-ZMK_SUBSCRIPTION(led_layer_color_listener, zmk_layer_state_changed);
-ZMK_SUBSCRIPTION(led_layer_color_listener, zmk_activity_state_changed);
-#endif // SHOW_LAYER_COLORS
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+// add the time since the last update to the on time and estimated charge of the lit channels of
+// a group, leaving their state as is; called with led_stats_lock held
+static void led_stats_flush_on_time(uint8_t group) {
+    uint32_t now = k_uptime_get_32();
+    uint32_t elapsed = now - led_stats.on_time_updated_ms[group];
 
-#if !IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL)
-void indicate_layer(void) {
-    uint8_t index = zmk_keymap_highest_layer_active();
-    static const struct blink_item blink = {.duration_ms = CONFIG_RGBLED_WIDGET_LAYER_BLINK_MS,
-                                            .color = CONFIG_RGBLED_WIDGET_LAYER_COLOR,
-                                            .sleep_ms = CONFIG_RGBLED_WIDGET_LAYER_BLINK_MS};
-    static const struct blink_item last_blink = {.duration_ms = CONFIG_RGBLED_WIDGET_LAYER_BLINK_MS,
-                                                 .color = CONFIG_RGBLED_WIDGET_LAYER_COLOR};
-    LOG_INF("Blinking %d times %s for layer change", index,
-            color_names[CONFIG_RGBLED_WIDGET_LAYER_COLOR]);
-
-    for (int i = 0; i < index; i++) {
-        if (i < index - 1) {
-            k_msgq_put(&led_msgq, &blink, K_NO_WAIT);
-        } else {
-            k_msgq_put(&led_msgq, &last_blink, K_NO_WAIT);
+    for (uint8_t pos = 0; pos < 3; pos++) {
+        if (BIT(pos) & led_stats.on_color[group]) {
+            led_stats.on_time_ms[pos] += elapsed;
+            led_stats.charge_ua_ms[pos] += (uint64_t)elapsed *
+                                           CONFIG_RGBLED_WIDGET_STATS_LED_CURRENT_UA *
+                                           led_stats.on_brightness[group] / LED_BRIGHTNESS_MAX;
         }
     }
+    led_stats.on_time_updated_ms[group] = now;
 }
-#endif // !IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL)
+#endif
 
-#if SHOW_LAYER_CHANGE
-static struct k_work_delayable layer_indicate_work;
+// account the on time of a group's LEDs up to now, then track their new state
+static void led_stats_update_on_time(uint8_t group, uint8_t color, uint8_t brightness) {
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+    K_SPINLOCK(&led_stats_lock) {
+        led_stats_flush_on_time(group);
+        led_stats.on_color[group] = color;
+        led_stats.on_brightness[group] = brightness;
+    }
+#endif
+}
 
-static int led_layer_listener_cb(const zmk_event_t *eh) {
-    // ignore if not initialized yet or layer off events
-    if (initialized && as_zmk_layer_state_changed(eh)->state) {
-        k_work_reschedule(&layer_indicate_work, K_MSEC(CONFIG_RGBLED_WIDGET_LAYER_DEBOUNCE_MS));
+// record the time from queuing an item to its first blink
+static void led_stats_update_latency(struct blink_item *blink) {
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+    if (blink->queued_ms == 0) {
+        return;
     }
-    return 0;
+    uint32_t latency = k_uptime_get_32() - blink->queued_ms;
+
+    blink->queued_ms = 0;
+    K_SPINLOCK(&led_stats_lock) {
+        led_stats.latency_count[blink->priority]++;
+        led_stats.latency_sum_ms[blink->priority] += latency;
+        led_stats.latency_max_ms[blink->priority] =
+            MAX(led_stats.latency_max_ms[blink->priority], latency);
+    }
+#endif
 }
 
-static void indicate_layer_cb(struct k_work *work) { indicate_layer(); }
+#if LED_PWM || LED_STRIP
+// brightness percentages per indicator, scaled by the global maximum
+#define SCALE_BRIGHTNESS(percent) ((percent) * CONFIG_RGBLED_WIDGET_BRIGHTNESS / 100)
 
-ZMK_LISTENER(led_layer_listener, led_layer_listener_cb);
-ZMK_SUBSCRIPTION(led_layer_listener, zmk_layer_state_changed);
-#endif // SHOW_LAYER_CHANGE
+static const uint8_t led_priority_brightness[LED_PRIO_COUNT] = {
+    [LED_PRIO_LAYER] = SCALE_BRIGHTNESS(CONFIG_RGBLED_WIDGET_LAYER_BRIGHTNESS),
+    [LED_PRIO_BATTERY] = SCALE_BRIGHTNESS(CONFIG_RGBLED_WIDGET_BATTERY_BRIGHTNESS),
+    [LED_PRIO_CONNECTIVITY] = SCALE_BRIGHTNESS(CONFIG_RGBLED_WIDGET_CONN_BRIGHTNESS),
+    [LED_PRIO_CRITICAL] = SCALE_BRIGHTNESS(CONFIG_RGBLED_WIDGET_BATTERY_CRITICAL_BRIGHTNESS),
+};
 
-extern void led_process_thread(void *d0, void *d1, void *d2) {
-    ARG_UNUSED(d0);
-    ARG_UNUSED(d1);
-    ARG_UNUSED(d2);
+#define PRIORITY_BRIGHTNESS(priority) led_priority_brightness[priority]
+#define LAYER_COLOR_BRIGHTNESS SCALE_BRIGHTNESS(CONFIG_RGBLED_WIDGET_LAYER_COLOR_BRIGHTNESS)
+#define IDLE_LAYER_COLOR_BRIGHTNESS                                                                \
+    (LAYER_COLOR_BRIGHTNESS * CONFIG_RGBLED_WIDGET_IDLE_LAYER_COLOR_BRIGHTNESS / 100)
+#else
+// GPIO LEDs are either fully on or off
+#define PRIORITY_BRIGHTNESS(priority) LED_BRIGHTNESS_MAX
+#define LAYER_COLOR_BRIGHTNESS LED_BRIGHTNESS_MAX
+#define IDLE_LAYER_COLOR_BRIGHTNESS                                                                \
+    (CONFIG_RGBLED_WIDGET_IDLE_LAYER_COLOR_BRIGHTNESS > 0 ? LED_BRIGHTNESS_MAX : 0)
+#endif
 
-    k_work_init_delayable(&indicate_connectivity_work, indicate_connectivity_cb);
+#if LED_PWM
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_ANIMATION)
+// animation frames are computed on the system work queue at a fixed rate while a fade or breath
+// is in progress, their cost in cycles is tracked in the statistics
+#define ANIM_FRAME_MS (1000 / CONFIG_RGBLED_WIDGET_ANIMATION_FPS)
+#define ANIM_FADE_FRAMES MAX(CONFIG_RGBLED_WIDGET_FADE_MS / ANIM_FRAME_MS, 1)
+#define ANIM_BREATHE_FRAMES MAX(CONFIG_RGBLED_WIDGET_BREATHE_PERIOD_MS / ANIM_FRAME_MS, 2)
+#define ANIM_BREATHE_MIN_SCALE (CONFIG_RGBLED_WIDGET_BREATHE_MIN_BRIGHTNESS * 256 / 100)
 
-#if SHOW_LAYER_CHANGE
-    k_work_init_delayable(&layer_indicate_work, indicate_layer_cb);
+// map from perceived brightness to PWM duty percentage, approximating a gamma of 2.5
+#define GAMMA_ENTRY(i, _) (((i) * (i) + (i) * (i) * (i) / 100 + 100) / 200)
+BUILD_ASSERT(LED_BRIGHTNESS_MAX == 100, "Gamma table assumes brightness percentages");
+static const uint8_t led_gamma[] = {LISTIFY(101, GAMMA_ENTRY, (, ))};
+
+// per channel brightness state, levels are percentages in 8.8 fixed point
+struct led_anim_channel {
+    uint16_t level;
+    uint16_t target;
+    uint16_t step;
+    uint8_t output;
+};
+
+static struct led_anim_channel led_anim_channels[3];
+static bool led_anim_breathing;
+static uint16_t led_anim_phase;
+static struct k_spinlock led_anim_lock;
+
+static void led_anim_frame_cb(struct k_work *work);
+static K_WORK_DEFINE(led_anim_frame_work, led_anim_frame_cb);
+
+// the timer expires in ISR context, so hand the frame off to the work queue
+static void led_anim_timer_cb(struct k_timer *timer) { k_work_submit(&led_anim_frame_work); }
+static K_TIMER_DEFINE(led_anim_timer, led_anim_timer_cb, NULL);
+
+static void led_anim_frame_cb(struct k_work *work) {
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+    uint32_t start = k_cycle_get_32();
 #endif
+    uint8_t outputs[3];
+    uint8_t changed = 0;
 
-    while (true) {
-        // wait until a blink item is received and process it
-        struct blink_item blink;
-        k_msgq_get(&led_msgq, &blink, K_FOREVER);
-        if (blink.duration_ms > 0) {
-            LOG_DBG("Got a blink item from msgq, color %d, duration %d", blink.color,
-                    blink.duration_ms);
-
-            // Blink the leds, using a separation blink if necessary
-            if (blink.color == led_current_color && blink.color > 0) {
-                set_rgb_leds(0, CONFIG_RGBLED_WIDGET_INTERVAL_MS);
+    K_SPINLOCK(&led_anim_lock) {
+        bool active = false;
+        uint16_t scale = 256;
+
+        if (led_anim_breathing) {
+            // triangle wave between the minimum and full brightness
+            uint16_t half = ANIM_BREATHE_FRAMES / 2;
+            led_anim_phase = (led_anim_phase + 1) % ANIM_BREATHE_FRAMES;
+            uint16_t ramp = led_anim_phase < half ? led_anim_phase : ANIM_BREATHE_FRAMES - led_anim_phase;
+            scale = ANIM_BREATHE_MIN_SCALE + (256 - ANIM_BREATHE_MIN_SCALE) * MIN(ramp, half) / half;
+            active = true;
+        }
+
+        for (uint8_t pos = 0; pos < 3; pos++) {
+            struct led_anim_channel *ch = &led_anim_channels[pos];
+            if (ch->level < ch->target) {
+                ch->level = MIN(ch->level + ch->step, ch->target);
+                active = true;
+            } else if (ch->level > ch->target) {
+                ch->level = MAX(ch->level - ch->step, ch->target);
+                active = true;
             }
-            set_rgb_leds(blink.color, blink.duration_ms);
-            if (blink.color == led_layer_color && blink.color > 0) {
-                set_rgb_leds(0, CONFIG_RGBLED_WIDGET_INTERVAL_MS);
+            outputs[pos] = led_gamma[((ch->level >> 8) * scale) >> 8];
+            if (outputs[pos] != ch->output) {
+                ch->output = outputs[pos];
+                changed |= BIT(pos);
             }
-            // wait interval before processing another blink
-            set_rgb_leds(led_layer_color,
-                         blink.sleep_ms > 0 ? blink.sleep_ms : CONFIG_RGBLED_WIDGET_INTERVAL_MS);
+        }
 
-        } else {
-            LOG_DBG("Got a layer color item from msgq, color %d", blink.color);
-            set_rgb_leds(blink.color, 0);
+        // stop generating frames once the LED is steady
+        if (!active) {
+            k_timer_stop(&led_anim_timer);
+        }
+    }
+
+    // the LED driver may block, so the outputs are set outside of the lock; led_anim_off waits
+    // for a running frame to finish before turning the channels off
+    for (uint8_t pos = 0; pos < 3; pos++) {
+        if (changed & BIT(pos)) {
+            led_set_brightness(led_groups[0].dev, led_groups[0].rgb_idx[pos], outputs[pos]);
         }
     }
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+    uint32_t cycles = k_cycle_get_32() - start;
+
+    K_SPINLOCK(&led_stats_lock) {
+        led_stats.anim_frames++;
+        led_stats.anim_frame_cycles += cycles;
+        led_stats.anim_frame_cycles_max = MAX(led_stats.anim_frame_cycles_max, cycles);
+    }
+#endif
 }
 
-// define led_process_thread with stack size 1024, start running it 100 ms after
-// boot
-K_THREAD_DEFINE(led_process_tid, 1024, led_process_thread, NULL, NULL, NULL,
-                K_LOWEST_APPLICATION_THREAD_PRIO, 0, 100);
+// fade the channels to new brightness percentages
+static void led_anim_fade_to(const uint8_t levels[3]) {
+    K_SPINLOCK(&led_anim_lock) {
+        for (uint8_t pos = 0; pos < 3; pos++) {
+            struct led_anim_channel *ch = &led_anim_channels[pos];
+            ch->target = levels[pos] << 8;
+            ch->step = MAX(abs(ch->target - ch->level) / ANIM_FADE_FRAMES, 1);
+        }
+        led_anim_breathing = false;
+        k_timer_start(&led_anim_timer, K_NO_WAIT, K_MSEC(ANIM_FRAME_MS));
+    }
+}
 
-extern void led_init_thread(void *d0, void *d1, void *d2) {
-    ARG_UNUSED(d0);
-    ARG_UNUSED(d1);
-    ARG_UNUSED(d2);
+// turn the channels off right away, stopping any fade or breath, since ZMK powers off right after
+// raising the sleep event and leaves no time for frames
+static void led_anim_off(void) {
+    struct k_work_sync sync;
+    uint8_t changed = 0;
 
-#if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
-    // check and indicate battery level on thread start
-    LOG_INF("Indicating initial battery status");
+    K_SPINLOCK(&led_anim_lock) {
+        k_timer_stop(&led_anim_timer);
+        led_anim_breathing = false;
+        for (uint8_t pos = 0; pos < 3; pos++) {
+            struct led_anim_channel *ch = &led_anim_channels[pos];
+            ch->level = 0;
+            ch->target = 0;
+            if (ch->output != 0) {
+                ch->output = 0;
+                changed |= BIT(pos);
+            }
+        }
+    }
+    // a frame that already took the lock may still be setting its outputs, so wait for it
+    k_work_cancel_sync(&led_anim_frame_work, &sync);
 
-    indicate_battery();
+    for (uint8_t pos = 0; pos < 3; pos++) {
+        if (changed & BIT(pos)) {
+            led_set_brightness(led_groups[0].dev, led_groups[0].rgb_idx[pos], 0);
+        }
+    }
+}
 
-    // wait until blink should be displayed for further checks
-    k_sleep(K_MSEC(CONFIG_RGBLED_WIDGET_BATTERY_BLINK_MS + CONFIG_RGBLED_WIDGET_INTERVAL_MS));
-#endif // IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_BREATHE_LAYER_COLORS)
+// start breathing the current color, starting from full brightness
+static void led_anim_breathe(void) {
+    K_SPINLOCK(&led_anim_lock) {
+        if (!led_anim_breathing) {
+            led_anim_breathing = true;
+            led_anim_phase = ANIM_BREATHE_FRAMES / 2;
+            k_timer_start(&led_anim_timer, K_NO_WAIT, K_MSEC(ANIM_FRAME_MS));
+        }
+    }
+}
+#endif // IS_ENABLED(CONFIG_RGBLED_WIDGET_BREATHE_LAYER_COLORS)
+#endif // IS_ENABLED(CONFIG_RGBLED_WIDGET_ANIMATION)
+#endif // LED_PWM
 
-    // check and indicate current profile or peripheral connectivity status
-    LOG_INF("Indicating initial connectivity status");
-    indicate_connectivity();
+#if LED_STRIP
+// framebuffer of the strip, pushed to the strip from the work queue only if a pixel changed
+static struct led_rgb strip_pixels[STRIP_LEN];
+static bool strip_dirty;
 
-#if SHOW_LAYER_COLORS
-    LOG_INF("Setting initial layer color");
-    update_layer_color();
-#endif // SHOW_LAYER_COLORS
+// uptime at which each pixel is turned off, zero for pixels that stay on
+static uint32_t strip_expiry_ms[STRIP_LEN];
+static struct k_spinlock strip_lock;
 
-    initialized = true;
-    LOG_INF("Finished initializing LED widget");
+static void strip_update_cb(struct k_work *work) {
+    struct led_rgb frame[STRIP_LEN];
+    bool dirty;
+    int32_t next_expiry_ms = -1;
+
+    K_SPINLOCK(&strip_lock) {
+        uint32_t now = k_uptime_get_32();
+        for (uint8_t pixel = 0; pixel < STRIP_LEN; pixel++) {
+            if (strip_expiry_ms[pixel] == 0) {
+                continue;
+            }
+            int32_t remaining = strip_expiry_ms[pixel] - now;
+            if (remaining <= 0) {
+                strip_pixels[pixel] = (struct led_rgb){0};
+                strip_expiry_ms[pixel] = 0;
+                strip_dirty = true;
+            } else if (next_expiry_ms < 0 || remaining < next_expiry_ms) {
+                next_expiry_ms = remaining;
+            }
+        }
+
+        // drivers can modify the pixel data while sending, so send a copy
+        dirty = strip_dirty;
+        strip_dirty = false;
+        if (dirty) {
+            memcpy(frame, strip_pixels, sizeof(frame));
+        }
+    }
+
+    if (dirty) {
+        led_strip_update_rgb(strip_dev, frame, STRIP_LEN);
+    }
+    if (next_expiry_ms >= 0) {
+        k_work_reschedule(k_work_delayable_from_work(work), K_MSEC(next_expiry_ms));
+    }
 }
 
-// run init thread on boot for initial battery+output checks
-K_THREAD_DEFINE(led_init_tid, 1024, led_init_thread, NULL, NULL, NULL,
-                K_LOWEST_APPLICATION_THREAD_PRIO, 0, 200);
+static K_WORK_DELAYABLE_DEFINE(strip_update_work, strip_update_cb);
+
+// set a pixel to a color, turning it off after duration_ms unless it is zero
+static void strip_set_pixel(uint8_t pixel, uint8_t color, uint8_t brightness,
+                            uint32_t duration_ms) {
+    uint8_t level = brightness * led_brightness_level * UINT8_MAX / (100 * LED_BRIGHTNESS_MAX);
+    struct led_rgb rgb = {.r = (color & BIT(0)) ? level : 0,
+                          .g = (color & BIT(1)) ? level : 0,
+                          .b = (color & BIT(2)) ? level : 0};
+
+    K_SPINLOCK(&strip_lock) {
+        if (memcmp(&strip_pixels[pixel], &rgb, sizeof(rgb)) != 0) {
+            strip_pixels[pixel] = rgb;
+            strip_dirty = true;
+        }
+        // zero is reserved for pixels that stay on
+        strip_expiry_ms[pixel] = duration_ms > 0 ? MAX(k_uptime_get_32() + duration_ms, 1) : 0;
+    }
+    k_work_reschedule(&strip_update_work, K_NO_WAIT);
+}
+
+// clear all pixels and push the frame right away instead of from strip_update_work: ZMK powers
+// off right after raising the sleep event on the same work queue, and the pixels would otherwise
+// latch their last color through deep sleep
+static void strip_clear(void) {
+    struct led_rgb frame[STRIP_LEN] = {0};
+
+    K_SPINLOCK(&strip_lock) {
+        memset(strip_pixels, 0, sizeof(strip_pixels));
+        memset(strip_expiry_ms, 0, sizeof(strip_expiry_ms));
+        strip_dirty = false;
+    }
+    k_work_cancel_delayable(&strip_update_work);
+    led_strip_update_rgb(strip_dev, frame, STRIP_LEN);
+}
+#endif // LED_STRIP
+
+// low-level method to control the LEDs of a group, brightness is only used by PWM LEDs and LED
+// strips
+static void set_rgb_leds(struct led_group *grp, uint8_t color, uint8_t brightness) {
+#if LED_PWM
+    // strip pixels are scaled in strip_set_pixel instead
+    brightness = brightness * led_brightness_level / 100;
+#endif
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_TRACE)
+    LOG_INF("LED trace at %u ms: group %u %s, brightness %u", k_uptime_get_32(),
+            led_group_index(grp), color_names[color], color ? brightness : 0);
+#endif
+    led_stats_update_on_time(led_group_index(grp), color, brightness);
+
+#if LED_STRIP
+    // the indicator pixel is optional, if all statuses are shown on their own pixels
+    if (INDICATOR_PIXEL >= 0) {
+        strip_set_pixel(INDICATOR_PIXEL, color, brightness, 0);
+    }
+#elif LED_PWM && IS_ENABLED(CONFIG_RGBLED_WIDGET_ANIMATION)
+    if (color == 0 && (led_activity_state == ZMK_ACTIVITY_SLEEP || led_disabled)) {
+        // no fade when turning off for sleep or a toggle
+        led_anim_off();
+    } else if (color != grp->current_color || brightness != grp->current_brightness) {
+        uint8_t levels[3];
+        for (uint8_t pos = 0; pos < 3; pos++) {
+            levels[pos] = (BIT(pos) & color) ? brightness : 0;
+        }
+        led_anim_fade_to(levels);
+    }
+#elif LED_PWM
+    for (uint8_t pos = 0; pos < 3; pos++) {
+        uint8_t bit = BIT(pos);
+        uint8_t level = (bit & color) ? brightness : 0;
+        if (level != ((bit & grp->current_color) ? grp->current_brightness : 0)) {
+            led_set_brightness(grp->dev, grp->rgb_idx[pos], level);
+        }
+    }
+#elif LED_GPIO_PORT
+    if (grp->port_pins != 0) {
+        // a single write switches all channels at once, without showing intermediate colors
+        gpio_port_value_t value = 0;
+        for (uint8_t pos = 0; pos < 3; pos++) {
+            if (BIT(pos) & color) {
+                value |= BIT(grp->gpios[pos].pin);
+            }
+        }
+        if (color != grp->current_color) {
+            gpio_port_set_masked(grp->gpios[0].port, grp->port_pins, value);
+        }
+    } else {
+        for (uint8_t pos = 0; pos < 3; pos++) {
+            uint8_t bit = BIT(pos);
+            if ((bit & grp->current_color) != (bit & color)) {
+                gpio_pin_set_dt(&grp->gpios[pos], (bit & color) != 0);
+            }
+        }
+    }
+#else
+    for (uint8_t pos = 0; pos < 3; pos++) {
+        uint8_t bit = BIT(pos);
+        if ((bit & grp->current_color) != (bit & color)) {
+            // bits are different, so we need to change one
+            if (bit & color) {
+                led_on(grp->dev, grp->rgb_idx[pos]);
+            } else {
+                led_off(grp->dev, grp->rgb_idx[pos]);
+            }
+        }
+    }
+#endif
+    grp->current_color = color;
+    grp->current_brightness = brightness;
+}
+
+// brightness of persistent layer colors, dimmed while idle and off while asleep
+static uint8_t layer_color_brightness(void) {
+    if (led_disabled) {
+        return 0;
+    }
+
+    switch (led_activity_state) {
+    case ZMK_ACTIVITY_IDLE:
+        return IDLE_LAYER_COLOR_BRIGHTNESS;
+    case ZMK_ACTIVITY_SLEEP:
+        return 0;
+    default:
+        return LAYER_COLOR_BRIGHTNESS;
+    }
+}
+
+// show the persistent layer color, breathing it if enabled
+static void set_layer_color_leds(struct led_group *grp, uint8_t color) {
+    uint8_t brightness = layer_color_brightness();
+
+    if (brightness == 0) {
+        color = 0;
+    }
+
+    set_rgb_leds(grp, color, brightness);
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_BREATHE_LAYER_COLORS)
+    if (color > 0) {
+        led_anim_breathe();
+    }
+#endif
+}
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_SEQUENCER_THREAD)
+extern const k_tid_t led_init_tid;
+#endif
+
+static inline bool blink_item_is_stale(const struct led_group *grp,
+                                       const struct blink_item *blink) {
+    return blink->generation != grp->generation[blink->priority];
+}
+
+// step value for the final gap after a superseded item was cut short
+#define LED_SEQ_STEP_SUPERSEDED UINT8_MAX
+
+// whether the item being shown was superseded and its current hold should be cut short
+static inline bool led_seq_superseded(const struct led_group *grp) {
+    return grp->seq_step != LED_SEQ_STEP_SUPERSEDED && blink_item_is_stale(grp, &grp->seq_item);
+}
+
+// start a new sequence of items for a priority class, which supersedes its pending items and
+// cuts short the item being shown if it belongs to the same class
+static uint8_t led_queue_new_sequence(enum led_priority priority) {
+    struct led_group *grp = led_group_for(priority);
+    uint8_t generation;
+
+    K_SPINLOCK(&grp->queue_lock) { generation = ++grp->generation[priority]; }
+
+    if (grp->seq_active && grp->seq_item.priority == priority) {
+        // stop holding the current step, the sequencer drops the stale item on its next step
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_SEQUENCER_THREAD)
+        k_wakeup(grp->tid);
+#elif IS_ENABLED(CONFIG_RGBLED_WIDGET_SEQUENCER_WORKQUEUE)
+        k_work_reschedule(&grp->seq_work, K_NO_WAIT);
+#endif
+    }
+    return generation;
+}
+
+static inline bool blink_item_same_pattern(const struct blink_item *a, const struct blink_item *b) {
+    return a->pattern == b->pattern && a->arg == b->arg && a->step == b->step &&
+           a->done == b->done;
+}
+
+static void led_queue_remove(struct led_group *grp, uint8_t idx) {
+    memmove(&grp->queue[idx], &grp->queue[idx + 1],
+            (grp->queue_len - idx - 1) * sizeof(struct blink_item));
+    grp->queue_len--;
+}
+
+// index of the oldest item with the highest priority, or -1 if empty
+static int led_queue_peek(struct led_group *grp) {
+    int best = -1;
+
+    for (int i = 0; i < grp->queue_len;) {
+        // drop items superseded by a newer sequence that did not queue anything
+        if (blink_item_is_stale(grp, &grp->queue[i])) {
+            LED_STATS_INC(superseded, grp->queue[i].priority);
+            led_queue_remove(grp, i);
+            continue;
+        }
+        if (best < 0 || grp->queue[i].priority > grp->queue[best].priority) {
+            best = i;
+        }
+        i++;
+    }
+    return best;
+}
+
+static bool led_queue_insert(struct led_group *grp, const struct blink_item *blink,
+                             bool at_front) {
+    bool collapsed = false;
+
+    // drop stale items of the same class, keeping the position of one with the same pattern
+    for (int i = 0; i < grp->queue_len;) {
+        struct blink_item *item = &grp->queue[i];
+        if (item->priority == blink->priority && item->generation != blink->generation) {
+            if (!collapsed && blink_item_same_pattern(item, blink)) {
+                item->generation = blink->generation;
+                collapsed = true;
+            } else {
+                LED_STATS_INC(superseded, item->priority);
+                led_queue_remove(grp, i);
+                continue;
+            }
+        }
+        i++;
+    }
+    if (collapsed) {
+        return true;
+    }
+
+    if (grp->queue_len == ARRAY_SIZE(grp->queue)) {
+        // make room by evicting the newest item of the lowest priority, if below the new one
+        int victim = -1;
+        for (int i = 0; i < grp->queue_len; i++) {
+            if (grp->queue[i].priority < blink->priority &&
+                (victim < 0 || grp->queue[i].priority <= grp->queue[victim].priority)) {
+                victim = i;
+            }
+        }
+        grp->overflows++;
+        if (victim < 0) {
+            LED_STATS_INC(dropped, blink->priority);
+            return false;
+        }
+        LED_STATS_INC(dropped, grp->queue[victim].priority);
+        led_queue_remove(grp, victim);
+    }
+
+    uint8_t idx = at_front ? 0 : grp->queue_len;
+    memmove(&grp->queue[idx + 1], &grp->queue[idx],
+            (grp->queue_len - idx) * sizeof(struct blink_item));
+    grp->queue[idx] = *blink;
+    grp->queue_len++;
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+    K_SPINLOCK(&led_stats_lock) {
+        led_stats.queue_high_water = MAX(led_stats.queue_high_water, grp->queue_len);
+    }
+#endif
+    return true;
+}
+
+static void led_queue_wake_sequencer(struct led_group *grp) {
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_SEQUENCER_THREAD)
+    k_sem_give(&grp->queue_sem);
+#elif IS_ENABLED(CONFIG_RGBLED_WIDGET_SEQUENCER_WORKQUEUE)
+    // no effect if the sequencer is already waiting for the next step
+    k_work_schedule(&grp->seq_work, K_NO_WAIT);
+#endif
+}
+
+// whether a blink item should be skipped to save power
+static bool led_queue_power_saving(const struct blink_item *blink) {
+    if (led_activity_state == ZMK_ACTIVITY_SLEEP || led_disabled) {
+        return true;
+    }
+
+#if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING) && CONFIG_RGBLED_WIDGET_BATTERY_SAVER_LEVEL > 0
+    // persistent color items are kept so that the layer color stays correct, and blinks requested
+    // with the behavior are always shown; the local battery decides, since it powers these LEDs
+    // even if a blink shows the level of another part
+    uint8_t battery_level = zmk_battery_state_of_charge();
+    if (!blink->requested && !blink_item_is_persistent(blink) &&
+        blink->priority < LED_PRIO_CRITICAL && battery_level > 0 &&
+        battery_level < CONFIG_RGBLED_WIDGET_BATTERY_SAVER_LEVEL) {
+        return true;
+    }
+#endif
+    return false;
+}
+
+// queue a blink item on the group of its priority class and wake up its sequencer if it is idle
+static void led_queue_put(const struct blink_item *blink) {
+    struct led_group *grp = led_group_for(blink->priority);
+    bool queued;
+    uint32_t overflows;
+
+    if (led_queue_power_saving(blink)) {
+        LOG_DBG("Skipping blink item with pattern %d to save power", blink->pattern);
+        return;
+    }
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+    struct blink_item stamped = *blink;
+
+    // zero is reserved for items whose latency was already recorded
+    stamped.queued_ms = MAX(k_uptime_get_32(), 1);
+    blink = &stamped;
+#endif
+
+    K_SPINLOCK(&grp->queue_lock) {
+        queued = led_queue_insert(grp, blink, false);
+        overflows = grp->overflows;
+    }
+    if (queued) {
+        LED_STATS_INC(queued, blink->priority);
+    }
+
+    if (!queued) {
+        LOG_WRN("Blink queue full, dropped item with pattern %d (%u dropped so far)",
+                blink->pattern, overflows);
+        return;
+    }
+    led_queue_wake_sequencer(grp);
+}
+
+// show an item right away on its own strip pixel if it has one, otherwise queue it for the
+// sequencer to show on the indicator LED
+static void led_queue_put_pixel(const struct blink_item *blink, int pixel) {
+#if LED_STRIP
+    if (pixel >= 0) {
+        if (led_queue_power_saving(blink)) {
+            return;
+        }
+        LED_STATS_INC(queued, blink->priority);
+        // pixels of their own only show the first step of a pattern
+        if (!blink_item_is_persistent(blink)) {
+            strip_set_pixel(pixel, blink_item_color(blink), PRIORITY_BRIGHTNESS(blink->priority),
+                            blink_item_on_ms(blink));
+        } else {
+            strip_set_pixel(pixel, blink_item_color(blink), layer_color_brightness(), 0);
+        }
+        return;
+    }
+#else
+    ARG_UNUSED(pixel);
+#endif
+    led_queue_put(blink);
+}
+
+// take the next item to process, returning false if the queue is empty
+static bool led_queue_get(struct led_group *grp, struct blink_item *blink) {
+    bool found = false;
+
+    K_SPINLOCK(&grp->queue_lock) {
+        int idx = led_queue_peek(grp);
+        if (idx >= 0) {
+            *blink = grp->queue[idx];
+            led_queue_remove(grp, idx);
+            found = true;
+        }
+    }
+    return found;
+}
+
+// put back the remainder of an item in progress if a higher priority one is waiting
+static bool led_queue_yield(struct led_group *grp, const struct blink_item *blink) {
+    bool yielded = false;
+
+    K_SPINLOCK(&grp->queue_lock) {
+        int idx = led_queue_peek(grp);
+        if (idx >= 0 && grp->queue[idx].priority > blink->priority) {
+            // the remainder is dropped instead if a newer sequence superseded it
+            if (!blink_item_is_stale(grp, blink)) {
+                led_queue_insert(grp, blink, true);
+            }
+            yielded = true;
+        }
+    }
+    return yielded;
+}
+
+#if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+// battery sources are self (index 0) followed by the split peripherals, in pairing order
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_SHOW_PERIPHERALS) ||                                   \
+    IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_SHOW_ONLY_PERIPHERALS)
+#define BATTERY_SOURCE_COUNT (1 + ZMK_SPLIT_BLE_PERIPHERAL_COUNT)
+#else
+#define BATTERY_SOURCE_COUNT 1
+#endif
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_SHOW_ONLY_PERIPHERALS)
+#define BATTERY_SOURCE_FIRST 1
+#else
+#define BATTERY_SOURCE_FIRST 0
+#endif
+
+// battery level bands, in increasing order of level
+enum battery_band {
+    BATTERY_BAND_MISSING,
+    BATTERY_BAND_CRITICAL,
+    BATTERY_BAND_LOW,
+    BATTERY_BAND_MEDIUM,
+    BATTERY_BAND_HIGH,
+};
+#endif // IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+
+// snapshot of the last seen status, so that events only lead to blinks on transitions
+static struct {
+    // connectivity as the selected transport, BLE profile (if relevant) and resulting color
+    uint8_t conn_transport;
+    uint8_t conn_profile;
+    uint8_t conn_color;
+    bool conn_valid;
+#if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+    // battery band per source and uptime of the last critical alert
+    uint8_t battery_band[BATTERY_SOURCE_COUNT];
+    uint32_t critical_alert_ms[BATTERY_SOURCE_COUNT];
+#endif
+#if HAS_LAYER_STATE
+    // highest active layer
+    uint8_t layer;
+#endif
+} led_status;
+
+// set by indicate_connectivity so that the next connectivity blink is shown even if unchanged,
+// and in battery saver mode
+static atomic_t conn_indicate_forced;
+
+static void indicate_connectivity_internal(void) {
+    struct blink_item blink = {.pattern = LED_PATTERN_BLINK, .priority = LED_PRIO_CONNECTIVITY};
+    uint8_t color;
+    uint8_t transport = 0;
+    uint8_t profile = UINT8_MAX;
+
+#if !IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL)
+#if IS_ENABLED(CONFIG_ZMK_BLE)
+    uint8_t profile_index = zmk_ble_active_profile_index();
+#endif
+
+    transport = zmk_endpoint_get_selected().transport;
+    switch (transport) {
+    case ZMK_TRANSPORT_USB: // USB connected and selected
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_CONN_SHOW_USB)
+        LOG_INF("USB connected, blinking %s", color_names[led_config.conn_color_usb]);
+        color = led_config.conn_color_usb;
+        break;
+#endif
+    case ZMK_TRANSPORT_BLE: // BLE connected and selected
+#if IS_ENABLED(CONFIG_ZMK_BLE)
+        LOG_CONN_CENTRAL(profile_index, "connected", connected);
+        color = led_config.conn_color_connected;
+        profile = profile_index;
+        break;
+#endif
+    default: // ZMK_TRANSPORT_NONE, neither BLE nor USB connected
+#if IS_ENABLED(CONFIG_ZMK_BLE)
+        if (zmk_endpoint_get_preferred_transport() != ZMK_TRANSPORT_NONE &&
+            zmk_ble_active_profile_is_open()) {
+            LOG_CONN_CENTRAL(profile_index, "open", advertising);
+            color = led_config.conn_color_advertising;
+            profile = profile_index;
+            break;
+        }
+#endif
+        LOG_CONN_CENTRAL(-1, "no endpoints connected", disconnected);
+        color = led_config.conn_color_disconnected;
+        break;
+    }
+#elif IS_ENABLED(CONFIG_ZMK_SPLIT_BLE)
+    if (zmk_split_bt_peripheral_is_connected()) {
+        LOG_CONN_PERIPHERAL("connected", connected);
+        color = led_config.conn_color_connected;
+    } else {
+        LOG_CONN_PERIPHERAL("not connected", disconnected);
+        color = led_config.conn_color_disconnected;
+    }
+#endif
+
+    // events that did not change the status are ignored, unless a blink was requested
+    bool forced = atomic_clear(&conn_indicate_forced) != 0;
+    if (!forced && led_status.conn_valid && led_status.conn_transport == transport &&
+        led_status.conn_profile == profile && led_status.conn_color == color) {
+        LOG_INF("Connectivity status unchanged, not blinking");
+        LED_STATS_INC(unchanged, LED_PRIO_CONNECTIVITY);
+        return;
+    }
+    led_status.conn_transport = transport;
+    led_status.conn_profile = profile;
+    led_status.conn_color = color;
+    led_status.conn_valid = true;
+
+    blink.arg = BLINK_ARG(color, 0);
+    blink.requested = forced;
+    blink.generation = led_queue_new_sequence(LED_PRIO_CONNECTIVITY);
+    led_queue_put_pixel(&blink, CONN_PIXEL);
+}
+
+// debouncing to ignore all but last connectivity event, to prevent repeat blinks
+static void indicate_connectivity_cb(struct k_work *work) { indicate_connectivity_internal(); }
+static K_WORK_DELAYABLE_DEFINE(indicate_connectivity_work, indicate_connectivity_cb);
+
+void indicate_connectivity() {
+    atomic_set(&conn_indicate_forced, 1);
+    k_work_reschedule(&indicate_connectivity_work, K_MSEC(16));
+}
+
+static int led_output_listener_cb(const zmk_event_t *eh) {
+    if (initialized) {
+        k_work_reschedule(&indicate_connectivity_work, K_MSEC(16));
+    }
+    return 0;
+}
+
+ZMK_LISTENER(led_output_listener, led_output_listener_cb);
+
+#if !IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL)
+// run led_output_listener_cb on endpoint and BLE profile change (on central)
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_CONN_SHOW_USB)
+ZMK_SUBSCRIPTION(led_output_listener, zmk_endpoint_changed);
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BLE)
+ZMK_SUBSCRIPTION(led_output_listener, zmk_ble_active_profile_changed);
+#endif // IS_ENABLED(CONFIG_ZMK_BLE)
+#elif IS_ENABLED(CONFIG_ZMK_SPLIT_BLE)
+// run led_output_listener_cb on peripheral status change event
+ZMK_SUBSCRIPTION(led_output_listener, zmk_split_peripheral_status_changed);
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+static inline uint8_t get_battery_color(uint8_t battery_level) {
+    if (battery_level == 0) {
+        LOG_INF("Battery level undetermined (zero), blinking %s",
+                color_names[led_config.battery_color_missing]);
+        return led_config.battery_color_missing;
+    }
+    if (battery_level >= led_config.battery_level_high) {
+        LOG_BATTERY(battery_level, high);
+        return led_config.battery_color_high;
+    }
+    if (battery_level >= led_config.battery_level_low) {
+        LOG_BATTERY(battery_level, medium);
+        return led_config.battery_color_medium;
+    }
+    LOG_BATTERY(battery_level, low);
+    return led_config.battery_color_low;
+}
+
+// last reported battery level per source, zero if not reported yet
+static uint8_t battery_levels[BATTERY_SOURCE_COUNT];
+
+// sources with a requested blink that are waiting for their first report
+static ATOMIC_DEFINE(battery_pending, BATTERY_SOURCE_COUNT);
+
+// queue sequence of the last battery indication and whether it was requested with the behavior,
+// also used by deferred blinks
+static uint8_t battery_sequence;
+static bool battery_requested;
+
+static uint8_t battery_level_get(uint8_t source) {
+    // refresh from the cached values kept by ZMK, none of these block
+    if (source == 0) {
+        battery_levels[0] = zmk_battery_state_of_charge();
+    }
+#if BATTERY_SOURCE_COUNT > 1
+    else if (zmk_split_central_get_peripheral_battery_level(source - 1, &battery_levels[source]) !=
+             0) {
+        LOG_ERR("Error looking up battery level for peripheral %d", source - 1);
+    }
+#endif
+    return battery_levels[source];
+}
+
+#if LED_STRIP && DT_NODE_HAS_PROP(STRIP_NODE_ID, battery_pixels)
+static const uint8_t battery_pixels[] = DT_PROP(STRIP_NODE_ID, battery_pixels);
+#endif
+
+// strip pixel for a battery source, -1 if it is shown on the indicator LED
+static int battery_pixel(uint8_t source) {
+#if LED_STRIP && DT_NODE_HAS_PROP(STRIP_NODE_ID, battery_pixels)
+    // wraps around for a source that is not shown
+    uint8_t idx = source - BATTERY_SOURCE_FIRST;
+
+    if (idx < ARRAY_SIZE(battery_pixels) && battery_pixels[idx] < STRIP_LEN) {
+        return battery_pixels[idx];
+    }
+#endif
+    return -1;
+}
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_HISTORY)
+#define BATTERY_HISTORY_SIZE CONFIG_RGBLED_WIDGET_BATTERY_HISTORY_SIZE
+
+// a battery level along with the uptime in seconds when it was first reported
+struct battery_sample {
+    uint32_t time_s;
+    uint8_t level;
+};
+
+// ring buffer of level changes per source, holding `len` samples with the oldest at `start`
+static struct battery_history {
+    struct battery_sample samples[BATTERY_HISTORY_SIZE];
+    uint8_t start;
+    uint8_t len;
+} battery_history[BATTERY_SOURCE_COUNT];
+
+static void battery_history_add(uint8_t source, uint8_t battery_level) {
+    struct battery_history *hist = &battery_history[source];
+
+    if (battery_level == 0) {
+        return;
+    }
+    if (hist->len > 0) {
+        uint8_t last = hist->samples[(hist->start + hist->len - 1) % BATTERY_HISTORY_SIZE].level;
+        if (battery_level == last) {
+            return;
+        }
+        // a rise past the hysteresis means charging, so the earlier samples say nothing about the
+        // discharge rate anymore; smaller rises are measurement noise and are ignored
+        if (battery_level > last) {
+            if (battery_level - last <= CONFIG_RGBLED_WIDGET_BATTERY_HYSTERESIS) {
+                return;
+            }
+            hist->len = 0;
+        }
+    }
+    if (hist->len == BATTERY_HISTORY_SIZE) {
+        hist->start = (hist->start + 1) % BATTERY_HISTORY_SIZE;
+        hist->len--;
+    }
+    hist->samples[(hist->start + hist->len) % BATTERY_HISTORY_SIZE] = (struct battery_sample){
+        .time_s = (uint32_t)(k_uptime_get() / MSEC_PER_SEC), .level = battery_level};
+    hist->len++;
+}
+
+// discharge rate in hundredths of a percent per hour from the oldest sample up to now at the
+// current level, so that it goes down while the level holds, zero without enough history yet
+static uint32_t battery_discharge_rate(uint8_t source, uint8_t battery_level) {
+    const struct battery_history *hist = &battery_history[source];
+
+    if (hist->len < 2) {
+        return 0;
+    }
+    const struct battery_sample *oldest = &hist->samples[hist->start];
+    uint32_t span_s = (uint32_t)(k_uptime_get() / MSEC_PER_SEC) - oldest->time_s;
+
+    if (span_s < CONFIG_RGBLED_WIDGET_BATTERY_HISTORY_MIN_SPAN_S ||
+        battery_level >= oldest->level) {
+        return 0;
+    }
+    return (oldest->level - battery_level) * 100U * 3600U / span_s;
+}
+
+// color for the estimated hours of use left, negative if no estimate is available yet
+static int get_battery_runtime_color(uint8_t source, uint8_t battery_level) {
+    uint32_t rate = battery_discharge_rate(source, battery_level);
+
+    if (rate == 0) {
+        LOG_INF("Not enough battery history for a time remaining estimate yet");
+        return -1;
+    }
+
+    uint32_t hours = battery_level * 100U / rate;
+    LOG_INF("Battery draining %u.%02u%% per hour, about %u hours remaining", rate / 100,
+            rate % 100, hours);
+
+    if (hours >= CONFIG_RGBLED_WIDGET_BATTERY_RUNTIME_HOURS_HIGH) {
+        return led_config.battery_color_high;
+    }
+    if (hours >= CONFIG_RGBLED_WIDGET_BATTERY_RUNTIME_HOURS_LOW) {
+        return led_config.battery_color_medium;
+    }
+    return led_config.battery_color_low;
+}
+#endif // IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_HISTORY)
+
+static void indicate_battery_source(uint8_t source, uint8_t battery_level) {
+    struct blink_item blink = {.pattern = LED_PATTERN_BLINK,
+                               .priority = LED_PRIO_BATTERY,
+                               .requested = battery_requested,
+                               .generation = battery_sequence};
+
+    if (source > 0) {
+        LOG_INF("Got battery level for peripheral %d:", source - 1);
+    }
+    uint8_t color = get_battery_color(battery_level);
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_RUNTIME_COLOR)
+    // use the time remaining instead of the level once it can be estimated
+    int runtime_color = battery_level > 0 ? get_battery_runtime_color(source, battery_level) : -1;
+    if (runtime_color >= 0) {
+        color = runtime_color;
+    }
+#endif
+    blink.arg = BLINK_ARG(color, 0);
+    led_queue_put_pixel(&blink, battery_pixel(source));
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_RUNTIME_EXTRA_BLINK)
+    // follow up with a shorter blink for the time remaining, on the indicator for LED strips so
+    // that it comes after the level
+    int runtime_color = battery_level > 0 ? get_battery_runtime_color(source, battery_level) : -1;
+    if (runtime_color >= 0) {
+        blink.pattern = LED_PATTERN_BATTERY_RUNTIME;
+        blink.arg = BLINK_ARG(runtime_color, 0);
+        led_queue_put(&blink);
+    }
+#endif
+}
+
+// show sources that did not report in time as missing
+static void battery_pending_timeout_cb(struct k_work *work) {
+    for (uint8_t source = BATTERY_SOURCE_FIRST; source < BATTERY_SOURCE_COUNT; source++) {
+        if (atomic_test_and_clear_bit(battery_pending, source)) {
+            indicate_battery_source(source, 0);
+        }
+    }
+}
+
+static K_WORK_DELAYABLE_DEFINE(battery_pending_timeout_work, battery_pending_timeout_cb);
+
+static void indicate_battery_internal(bool requested) {
+    bool deferred = false;
+
+    battery_sequence = led_queue_new_sequence(LED_PRIO_BATTERY);
+    battery_requested = requested;
+    for (uint8_t source = BATTERY_SOURCE_FIRST; source < BATTERY_SOURCE_COUNT; source++) {
+        uint8_t battery_level = battery_level_get(source);
+
+        if (battery_level > 0) {
+            indicate_battery_source(source, battery_level);
+        } else {
+            // blink once the source first reports, instead of waiting for it here
+            atomic_set_bit(battery_pending, source);
+            deferred = true;
+        }
+    }
+
+    if (deferred) {
+        k_work_reschedule(
+            &battery_pending_timeout_work,
+            K_MSEC(led_config.battery_blink_ms + led_config.interval_ms));
+    }
+}
+
+void indicate_battery(void) { indicate_battery_internal(true); }
+
+static enum battery_band battery_band_of(uint8_t battery_level) {
+    if (battery_level == 0) {
+        return BATTERY_BAND_MISSING;
+    }
+    if (battery_level <= led_config.battery_level_critical) {
+        return BATTERY_BAND_CRITICAL;
+    }
+    if (battery_level < led_config.battery_level_low) {
+        return BATTERY_BAND_LOW;
+    }
+    if (battery_level < led_config.battery_level_high) {
+        return BATTERY_BAND_MEDIUM;
+    }
+    return BATTERY_BAND_HIGH;
+}
+
+// update the band of a source, dropping to a lower band right away but only rising into a higher
+// one once the level is past its threshold by the hysteresis, so that a level fluctuating around
+// a threshold does not flip between bands
+static enum battery_band battery_band_update(uint8_t source, uint8_t battery_level) {
+    enum battery_band band = led_status.battery_band[source];
+    enum battery_band lower = battery_band_of(battery_level);
+    enum battery_band upper =
+        battery_band_of(MAX(battery_level - CONFIG_RGBLED_WIDGET_BATTERY_HYSTERESIS, 1));
+
+    if (lower == BATTERY_BAND_MISSING || band == BATTERY_BAND_MISSING || lower < band) {
+        band = lower;
+    } else if (upper > band) {
+        band = upper;
+    }
+    led_status.battery_band[source] = band;
+    return band;
+}
+
+// blink critical when a source drops into the critical band, repeating at most once per
+// configured interval while it stays there
+static void battery_critical_check(uint8_t source, uint8_t battery_level) {
+    enum battery_band previous = led_status.battery_band[source];
+
+    if (battery_band_update(source, battery_level) != BATTERY_BAND_CRITICAL || !initialized) {
+        return;
+    }
+
+    uint32_t now = k_uptime_get_32();
+    if (previous == BATTERY_BAND_CRITICAL &&
+        (CONFIG_RGBLED_WIDGET_BATTERY_CRITICAL_REPEAT_S == 0 ||
+         now - led_status.critical_alert_ms[source] <
+             CONFIG_RGBLED_WIDGET_BATTERY_CRITICAL_REPEAT_S * MSEC_PER_SEC)) {
+        LED_STATS_INC(unchanged, LED_PRIO_CRITICAL);
+        return;
+    }
+    led_status.critical_alert_ms[source] = now;
+
+    if (source > 0) {
+        LOG_INF("Got battery level for peripheral %d:", source - 1);
+    }
+    LOG_BATTERY(battery_level, critical);
+
+    struct blink_item blink = {.pattern = LED_PATTERN_BLINK,
+                               .arg = BLINK_ARG(led_config.battery_color_critical, 0),
+                               .priority = LED_PRIO_CRITICAL};
+    blink.generation = led_queue_new_sequence(LED_PRIO_CRITICAL);
+    led_queue_put_pixel(&blink, battery_pixel(source));
+}
+
+static void battery_level_update(uint8_t source, uint8_t battery_level) {
+    if (source >= BATTERY_SOURCE_COUNT) {
+        return;
+    }
+    battery_levels[source] = battery_level;
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_BATTERY_HISTORY)
+    battery_history_add(source, battery_level);
+#endif
+
+    if (battery_level > 0 && atomic_test_and_clear_bit(battery_pending, source)) {
+        indicate_battery_source(source, battery_level);
+    }
+
+    // sources are self and the peripherals with shown battery levels, if any
+    battery_critical_check(source, battery_level);
+}
+
+static int led_battery_listener_cb(const zmk_event_t *eh) {
+#if BATTERY_SOURCE_COUNT > 1
+    const struct zmk_peripheral_battery_state_changed *peripheral_ev =
+        as_zmk_peripheral_battery_state_changed(eh);
+    if (peripheral_ev != NULL) {
+        battery_level_update(peripheral_ev->source + 1, peripheral_ev->state_of_charge);
+        return 0;
+    }
+#endif
+
+    battery_level_update(0, as_zmk_battery_state_changed(eh)->state_of_charge);
+    return 0;
+}
+
+// run led_battery_listener_cb on battery state change events, from self and peripherals
+ZMK_LISTENER(led_battery_listener, led_battery_listener_cb);
+ZMK_SUBSCRIPTION(led_battery_listener, zmk_battery_state_changed);
+#if BATTERY_SOURCE_COUNT > 1
+ZMK_SUBSCRIPTION(led_battery_listener, zmk_peripheral_battery_state_changed);
+#endif
+#endif // IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+
+// the layer state is relayed from the central to peripherals, or to the widget itself with the
+// loopback transport
+#define LAYER_RELAY_SEND                                                                           \
+    (IS_ENABLED(CONFIG_RGBLED_WIDGET_LAYER_RELAY) &&                                               \
+     (IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL) ||                                                 \
+      IS_ENABLED(CONFIG_RGBLED_WIDGET_LAYER_RELAY_LOOPBACK)))
+#define LAYER_RELAY_RECEIVE                                                                        \
+    (IS_ENABLED(CONFIG_RGBLED_WIDGET_LAYER_RELAY) && !IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL))
+
+#if LAYER_RELAY_RECEIVE
+BUILD_ASSERT(!IS_ENABLED(CONFIG_ZMK_SPLIT) ||
+                 DT_HAS_COMPAT_STATUS_OKAY(zmk_behavior_rgbled_widget_layer_sync),
+             "CONFIG_RGBLED_WIDGET_LAYER_RELAY needs <behaviors/rgbled_widget_layer_sync.dtsi> "
+             "to be included in the keymap");
+
+// highest active layer as last received from the central
+static uint8_t led_relayed_layer = 0;
+
+static inline uint8_t led_highest_layer(void) { return led_relayed_layer; }
+#elif HAS_LAYER_STATE
+static inline uint8_t led_highest_layer(void) { return zmk_keymap_highest_layer_active(); }
+#endif
+
+uint8_t led_layer_color = 0;
+#if SHOW_LAYER_COLORS
+// queue the persistent layer color, to be shown after the blinks before it
+static void queue_layer_color(void) {
+    struct blink_item color = {.pattern = LED_PATTERN_LAYER_COLOR,
+                               .arg = BLINK_ARG(led_layer_color, 0),
+                               .priority = LED_PRIO_LAYER};
+    color.generation = led_queue_new_sequence(LED_PRIO_LAYER);
+    led_queue_put_pixel(&color, LAYER_PIXEL);
+}
+
+void update_layer_color(void) {
+    uint8_t index = led_highest_layer();
+
+    if (led_layer_color != led_config.layer_colors[index]) {
+        led_layer_color = led_config.layer_colors[index];
+        LOG_INF("Setting layer color to %s for layer %d", color_names[led_layer_color], index);
+        queue_layer_color();
+    }
+}
+
+#if !LAYER_RELAY_RECEIVE
+static int led_layer_color_listener_cb(const zmk_event_t *eh) {
+    if (initialized) {
+        update_layer_color();
+    }
+    return 0;
+}
+
+// run layer_color_listener_cb on layer status change event
+ZMK_LISTENER(led_layer_color_listener, led_layer_color_listener_cb);
+ZMK_SUBSCRIPTION(led_layer_color_listener, zmk_layer_state_changed);
+#endif // !LAYER_RELAY_RECEIVE
+#endif // SHOW_LAYER_COLORS
+
+// drop all blinks and turn off the LEDs, until led_reapply_layer_color
+static void led_turn_off(void) {
+    // supersede all pending and showing items, so that the sequencer stops as well
+    for (uint8_t priority = 0; priority < LED_PRIO_COUNT; priority++) {
+        led_queue_new_sequence(priority);
+    }
+    for (uint8_t i = 0; i < ARRAY_SIZE(led_groups); i++) {
+        set_rgb_leds(&led_groups[i], 0, 0);
+    }
+#if LED_STRIP
+    strip_clear();
+#endif
+}
+
+// re-apply the persistent color with the current brightness, after the blink being shown if any
+static void led_reapply_layer_color(void) {
+#if SHOW_LAYER_COLORS
+    if (initialized) {
+        led_layer_color = led_config.layer_colors[led_highest_layer()];
+        queue_layer_color();
+    }
+#endif
+}
+
+static int led_activity_listener_cb(const zmk_event_t *eh) {
+    enum zmk_activity_state state = as_zmk_activity_state_changed(eh)->state;
+
+    if (state == led_activity_state) {
+        return 0;
+    }
+    led_activity_state = state;
+
+    switch (state) {
+    case ZMK_ACTIVITY_SLEEP:
+        LOG_INF("Detected sleep activity state, dropping blinks and turning off LED");
+        led_turn_off();
+        break;
+    default:
+        LOG_INF("Detected %s activity state, updating layer color",
+                state == ZMK_ACTIVITY_IDLE ? "idle" : "active");
+        led_reapply_layer_color();
+        break;
+    }
+    return 0;
+}
+
+// run led_activity_listener_cb on activity state change events
+ZMK_LISTENER(led_activity_listener, led_activity_listener_cb);
+ZMK_SUBSCRIPTION(led_activity_listener, zmk_activity_state_changed);
+
+void rgbled_widget_toggle(void) {
+    led_disabled = !led_disabled;
+    LOG_INF("Turning indicators %s", led_disabled ? "off" : "on");
+
+    if (led_disabled) {
+        led_turn_off();
+    } else {
+        led_reapply_layer_color();
+    }
+}
+
+void rgbled_widget_cycle_brightness(void) {
+#if LED_PWM || LED_STRIP
+    // step down from full brightness, wrapping around after the lowest step
+    led_brightness_level = led_brightness_level > CONFIG_RGBLED_WIDGET_BRIGHTNESS_STEP
+                               ? led_brightness_level - CONFIG_RGBLED_WIDGET_BRIGHTNESS_STEP
+                               : 100;
+    LOG_INF("Setting brightness level to %d%%", led_brightness_level);
+
+    // show the new level with a white blink, followed by the layer color if any
+    struct blink_item blink = {.pattern = LED_PATTERN_BLINK,
+                               .arg = BLINK_ARG(7, 0), // white
+                               .priority = LED_PRIO_LAYER,
+                               .requested = true};
+    blink.generation = led_queue_new_sequence(LED_PRIO_LAYER);
+    led_queue_put(&blink);
+#if SHOW_LAYER_COLORS
+    struct blink_item color = {.pattern = LED_PATTERN_LAYER_COLOR,
+                               .arg = BLINK_ARG(led_layer_color, 0),
+                               .priority = LED_PRIO_LAYER,
+                               .requested = true,
+                               .generation = blink.generation};
+    led_queue_put_pixel(&color, LAYER_PIXEL);
+#endif
+#else
+    LOG_WRN("Brightness can only be changed for PWM LEDs and LED strips");
+#endif
+}
+
+#if HAS_LAYER_STATE
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_LAYER_CHANGE_COLOR_DIGITS)
+// number of colors available for digits, i.e. all but black
+#define LAYER_DIGIT_BASE 7
+
+static void indicate_layer_internal(bool requested) {
+    uint8_t index = led_highest_layer();
+    struct blink_item blink = {.priority = LED_PRIO_LAYER, .requested = requested};
+    uint8_t digits[3];
+    uint8_t num_digits = 0;
+
+    // superseding any pending layer indication; the base layer shows no blinks, like in the
+    // count mode, rather than a single red digit
+    blink.generation = led_queue_new_sequence(LED_PRIO_LAYER);
+    if (index == 0) {
+        LOG_INF("No blinks for the base layer");
+        return;
+    }
+
+    // colors red to white stand for digits 0 to 6, most significant digit first
+    for (uint8_t rest = index; num_digits == 0 || rest > 0; rest /= LAYER_DIGIT_BASE) {
+        digits[num_digits++] = rest % LAYER_DIGIT_BASE;
+    }
+
+    LOG_INF("Blinking %d color digits for layer %d", num_digits, index);
+
+    while (num_digits-- > 0) {
+        uint8_t color = digits[num_digits] + 1;
+        blink.pattern = num_digits > 0 ? LED_PATTERN_DIGIT : LED_PATTERN_BLINK;
+        blink.arg = BLINK_ARG(color, 0);
+        LOG_INF("Blinking %s for digit %d", color_names[color], digits[num_digits]);
+        led_queue_put(&blink);
+    }
+}
+#else
+static void indicate_layer_internal(bool requested) {
+    uint8_t index = led_highest_layer();
+
+    // superseding any pending layer indication
+    uint8_t generation = led_queue_new_sequence(LED_PRIO_LAYER);
+    if (index == 0) {
+        LOG_INF("No blinks for the base layer");
+    } else {
+        LOG_INF("Blinking %d times %s for layer change", index,
+                color_names[led_config.layer_color]);
+        // the count is encoded as repeats after the first blink
+        struct blink_item blink = {.pattern = LED_PATTERN_LAYER_COUNT,
+                                   .arg = BLINK_ARG(led_config.layer_color, index - 1),
+                                   .priority = LED_PRIO_LAYER,
+                                   .requested = requested,
+                                   .generation = generation};
+        led_queue_put(&blink);
+    }
+}
+#endif // IS_ENABLED(CONFIG_RGBLED_WIDGET_LAYER_CHANGE_COLOR_DIGITS)
+
+void indicate_layer(void) { indicate_layer_internal(true); }
+#endif // HAS_LAYER_STATE
+
+#if SHOW_LAYER_CHANGE
+static void indicate_layer_cb(struct k_work *work) {
+    uint8_t layer = led_highest_layer();
+    uint8_t previous = led_status.layer;
+
+    // only a change of the highest active layer blinks, in either direction, so toggling a
+    // layer below the highest active one does not repeat the last indication
+    led_status.layer = layer;
+    if (layer != previous) {
+        indicate_layer_internal(false);
+    } else {
+        LED_STATS_INC(unchanged, LED_PRIO_LAYER);
+    }
+}
+static K_WORK_DELAYABLE_DEFINE(layer_indicate_work, indicate_layer_cb);
+
+#if !LAYER_RELAY_RECEIVE
+static int led_layer_listener_cb(const zmk_event_t *eh) {
+    // off events are debounced too, so that the highest layer is tracked after them
+    if (initialized) {
+        k_work_reschedule(&layer_indicate_work, K_MSEC(CONFIG_RGBLED_WIDGET_LAYER_DEBOUNCE_MS));
+    }
+    return 0;
+}
+
+ZMK_LISTENER(led_layer_listener, led_layer_listener_cb);
+ZMK_SUBSCRIPTION(led_layer_listener, zmk_layer_state_changed);
+#endif // !LAYER_RELAY_RECEIVE
+#endif // SHOW_LAYER_CHANGE
+
+#if LAYER_RELAY_RECEIVE
+// called by the ind_sync behavior when the central relays a new highest active layer, to
+// drive the same layer color and layer change indications as on the central
+void update_relayed_layer(uint8_t layer) {
+    // ignore layers the local keymap has no color for
+    if (layer >= LED_LAYERS_LEN || layer == led_relayed_layer) {
+        return;
+    }
+    led_relayed_layer = layer;
+    LOG_DBG("Received relayed layer %d", layer);
+
+    if (!initialized) {
+        return;
+    }
+#if SHOW_LAYER_COLORS
+    update_layer_color();
+#endif
+#if SHOW_LAYER_CHANGE
+    k_work_reschedule(&layer_indicate_work, K_MSEC(CONFIG_RGBLED_WIDGET_LAYER_DEBOUNCE_MS));
+#endif
+}
+
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE)
+// fall back to the base layer while disconnected instead of keeping a stale one, the central
+// sends the current layer again once connected
+static int led_layer_relay_status_cb(const zmk_event_t *eh) {
+    if (!as_zmk_split_peripheral_status_changed(eh)->connected) {
+        update_relayed_layer(0);
+    }
+    return 0;
+}
+
+ZMK_LISTENER(led_layer_relay_status_listener, led_layer_relay_status_cb);
+ZMK_SUBSCRIPTION(led_layer_relay_status_listener, zmk_split_peripheral_status_changed);
+#endif
+#endif // LAYER_RELAY_RECEIVE
+
+#if LAYER_RELAY_SEND
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_LAYER_RELAY_LOOPBACK)
+#define LAYER_RELAY_TARGETS 1
+
+static int layer_relay_send(uint8_t target, uint8_t layer) {
+    update_relayed_layer(layer);
+    return 0;
+}
+#else
+#define LAYER_RELAY_TARGETS ZMK_SPLIT_BLE_PERIPHERAL_COUNT
+
+// name of the behavior that receives the layer on peripherals, split transports limit behavior
+// names to 8 characters
+#define LAYER_RELAY_BEHAVIOR "ind_sync"
+
+static int layer_relay_send(uint8_t target, uint8_t layer) {
+    struct zmk_behavior_binding binding = {.behavior_dev = LAYER_RELAY_BEHAVIOR, .param1 = layer};
+    struct zmk_behavior_binding_event event = {.timestamp = k_uptime_get()};
+
+    // only a press is sent, the behavior does nothing on release
+    return zmk_split_central_invoke_behavior(target, &binding, event, true);
+}
+#endif // IS_ENABLED(CONFIG_RGBLED_WIDGET_LAYER_RELAY_LOOPBACK)
+
+// last layer sent to each peripheral, peripherals start at the base layer
+static uint8_t layer_relay_sent[LAYER_RELAY_TARGETS];
+
+// peripherals known to be disconnected, which are sent the layer once they reconnect
+static uint32_t layer_relay_offline;
+
+static void layer_relay_cb(struct k_work *work) {
+    uint8_t layer = zmk_keymap_highest_layer_active();
+
+    for (uint8_t i = 0; i < LAYER_RELAY_TARGETS; i++) {
+        if (layer_relay_sent[i] == layer || (layer_relay_offline & BIT(i))) {
+            continue;
+        }
+        int err = layer_relay_send(i, layer);
+        if (err < 0) {
+            // e.g. not connected, so send it again on the next layer change
+            LOG_DBG("Failed to relay layer %d to peripheral %d: %d", layer, i, err);
+            layer_relay_sent[i] = UINT8_MAX;
+            continue;
+        }
+        layer_relay_sent[i] = layer;
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+        K_SPINLOCK(&led_stats_lock) { led_stats.relayed++; }
+#endif
+    }
+}
+static K_WORK_DELAYABLE_DEFINE(layer_relay_work, layer_relay_cb);
+
+static int led_layer_relay_listener_cb(const zmk_event_t *eh) {
+    // no rescheduling, so that changes arriving while waiting are sent together and the
+    // latency stays bounded by the delay
+    k_work_schedule(&layer_relay_work, K_MSEC(CONFIG_RGBLED_WIDGET_LAYER_RELAY_DELAY_MS));
+    return 0;
+}
+
+ZMK_LISTENER(led_layer_relay_listener, led_layer_relay_listener_cb);
+ZMK_SUBSCRIPTION(led_layer_relay_listener, zmk_layer_state_changed);
+
+#if !IS_ENABLED(CONFIG_RGBLED_WIDGET_LAYER_RELAY_LOOPBACK) &&                                      \
+    IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_CENTRAL_BATTERY_LEVEL_FETCHING)
+// sending only queues the layer, so a peripheral that is not connected misses it without an
+// error; ZMK reports a battery level of 0 for a peripheral that disconnects and its actual level
+// once it is connected again, which is used to send it the current layer after reconnecting
+static int led_layer_relay_peripheral_cb(const zmk_event_t *eh) {
+    const struct zmk_peripheral_battery_state_changed *ev =
+        as_zmk_peripheral_battery_state_changed(eh);
+
+    if (ev->source >= LAYER_RELAY_TARGETS) {
+        return 0;
+    }
+    if (ev->state_of_charge == 0) {
+        layer_relay_offline |= BIT(ev->source);
+    } else if (layer_relay_offline & BIT(ev->source)) {
+        // sent even for the base layer, which the peripheral may not have caught up with yet
+        LOG_DBG("Peripheral %d reconnected, relaying the layer again", ev->source);
+        layer_relay_offline &= ~BIT(ev->source);
+        layer_relay_sent[ev->source] = UINT8_MAX;
+        k_work_schedule(&layer_relay_work, K_MSEC(CONFIG_RGBLED_WIDGET_LAYER_RELAY_DELAY_MS));
+    }
+    return 0;
+}
+
+ZMK_LISTENER(led_layer_relay_peripheral_listener, led_layer_relay_peripheral_cb);
+ZMK_SUBSCRIPTION(led_layer_relay_peripheral_listener, zmk_peripheral_battery_state_changed);
+#endif
+#endif // LAYER_RELAY_SEND
+
+// color the LEDs of a group return to after blinks, the layer color for the group showing it
+// unless the layer color has its own pixel
+static inline uint8_t led_rest_color(const struct led_group *grp) {
+    return LAYER_PIXEL < 0 && grp == led_group_for(LED_PRIO_LAYER) ? led_layer_color : 0;
+}
+
+// perform the next step of the current blink item of a group, returning the duration in ms to
+// hold the resulting LED state for, or a negative value once the item is complete
+static int32_t led_seq_next_step(struct led_group *grp) {
+    struct blink_item *blink = &grp->seq_item;
+
+    if (grp->seq_step == LED_SEQ_STEP_SUPERSEDED) {
+        return -1;
+    }
+
+    if (blink_item_is_stale(grp, blink)) {
+        // superseded by a newer sequence while showing, so cut it short and only keep a gap
+        // to tell it apart from the next blink
+        LOG_DBG("Dropping superseded blink item, pattern %d", blink->pattern);
+        bool lit = grp->current_color != led_rest_color(grp);
+
+        grp->seq_step = LED_SEQ_STEP_SUPERSEDED;
+        set_layer_color_leds(grp, led_rest_color(grp));
+        if (!lit) {
+            return 0;
+        }
+        return blink_item_off_ms(blink);
+    }
+
+    if (blink_item_is_persistent(blink)) {
+        // layer color items only change the persistent color
+        if (grp->seq_step++ == 0) {
+            LOG_DBG("Got a layer color item from queue, color %d", blink_item_color(blink));
+            set_layer_color_leds(grp, blink_item_color(blink));
+            return 0;
+        }
+        return -1;
+    }
+
+    uint8_t color = blink_item_color(blink);
+
+    switch (grp->seq_step++) {
+    case 0:
+        // steps repeated zero times are skipped, e.g. a count from the argument
+        if (blink_item_repeat(blink) == 0) {
+            grp->seq_step = 4;
+            return 0;
+        }
+        LOG_DBG("Got a blink item from queue, pattern %d step %d, color %d", blink->pattern,
+                blink->step, color);
+
+        // use a separation blink if the color is already showing
+        if (color == grp->current_color && color > 0) {
+            set_rgb_leds(grp, 0, 0);
+            return led_config.interval_ms;
+        }
+        return 0;
+    case 1:
+        led_stats_update_latency(blink);
+        set_rgb_leds(grp, color, PRIORITY_BRIGHTNESS(blink->priority));
+        return blink_item_on_ms(blink);
+    case 2:
+        // use a separation blink if the layer color is the same as the blink
+        if (color == led_rest_color(grp) && color > 0) {
+            set_rgb_leds(grp, 0, 0);
+            return led_config.interval_ms;
+        }
+        return 0;
+    case 3:
+        // wait before the next repetition, step or item
+        set_layer_color_leds(grp, led_rest_color(grp));
+        blink->done++;
+        return blink_item_off_ms(blink);
+    default:
+        if (blink->done >= blink_item_repeat(blink)) {
+            blink->done = 0;
+            if (++blink->step == led_patterns[blink->pattern].num_steps) {
+                return -1;
+            }
+        }
+
+        // let higher priority items go first, so they only wait for a single repetition
+        if (led_queue_yield(grp, blink)) {
+            return -1;
+        }
+        grp->seq_step = 0;
+        return 0;
+    }
+}
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+static const char *priority_names[LED_PRIO_COUNT] = {"layer", "battery", "connectivity",
+                                                     "critical"};
+
+// print to the shell if given, otherwise to the log
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS_SHELL)
+#define STATS_PRINT(sh, fmt, ...)                                                                  \
+    do {                                                                                           \
+        if (sh) {                                                                                  \
+            shell_print(sh, fmt, ##__VA_ARGS__);                                                   \
+        } else {                                                                                   \
+            LOG_INF(fmt, ##__VA_ARGS__);                                                           \
+        }                                                                                          \
+    } while (0)
+#else
+#define STATS_PRINT(sh, fmt, ...) LOG_INF(fmt, ##__VA_ARGS__)
+#endif
+
+static void led_stats_print(const struct shell *sh) {
+    typeof(led_stats) stats;
+
+    // the LED state may change concurrently, so only the on time up to now is added here
+    K_SPINLOCK(&led_stats_lock) {
+        for (uint8_t i = 0; i < ARRAY_SIZE(led_groups); i++) {
+            led_stats_flush_on_time(i);
+        }
+        stats = led_stats;
+    }
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(led_groups); i++) {
+        struct led_group *grp = &led_groups[i];
+        uint8_t queue_len;
+        uint32_t overflows;
+
+        K_SPINLOCK(&grp->queue_lock) {
+            queue_len = grp->queue_len;
+            overflows = grp->overflows;
+        }
+        STATS_PRINT(sh, "Group %u queue: %u of %u items, %u overflows", i, queue_len,
+                    CONFIG_RGBLED_WIDGET_QUEUE_SIZE, overflows);
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_SEQUENCER_THREAD) && IS_ENABLED(CONFIG_THREAD_STACK_INFO)
+        size_t unused;
+        if (grp->tid != NULL && k_thread_stack_space_get(grp->tid, &unused) == 0) {
+            STATS_PRINT(sh, "Group %u sequencer thread stack: %zu bytes unused", i, unused);
+        }
+#endif
+    }
+    STATS_PRINT(sh, "Queue high water mark: %u", stats.queue_high_water);
+    for (uint8_t prio = 0; prio < LED_PRIO_COUNT; prio++) {
+        uint32_t count = stats.latency_count[prio];
+        STATS_PRINT(sh,
+                    "%s: %u queued, %u superseded, %u dropped, %u unchanged, latency avg %u ms, "
+                    "max %u ms",
+                    priority_names[prio], stats.queued[prio], stats.superseded[prio],
+                    stats.dropped[prio], stats.unchanged[prio],
+                    count ? stats.latency_sum_ms[prio] / count : 0, stats.latency_max_ms[prio]);
+    }
+    for (uint8_t pos = 0; pos < 3; pos++) {
+        STATS_PRINT(sh, "%s LED on time: %llu ms, estimated charge: %llu mA*ms",
+                    color_names[BIT(pos)], (unsigned long long)stats.on_time_ms[pos],
+                    (unsigned long long)(stats.charge_ua_ms[pos] / 1000));
+    }
+#if LAYER_RELAY_SEND
+    STATS_PRINT(sh, "Layer relay: %u layers sent", stats.relayed);
+#endif
+#if LED_PWM && IS_ENABLED(CONFIG_RGBLED_WIDGET_ANIMATION)
+    STATS_PRINT(sh, "Animation: %u frames, avg %u us, max %u us", stats.anim_frames,
+                stats.anim_frames
+                    ? k_cyc_to_us_floor32((uint32_t)(stats.anim_frame_cycles / stats.anim_frames))
+                    : 0,
+                k_cyc_to_us_floor32(stats.anim_frame_cycles_max));
+#endif
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_SEQUENCER_THREAD) && IS_ENABLED(CONFIG_THREAD_STACK_INFO)
+    size_t unused;
+    if (k_thread_stack_space_get(led_init_tid, &unused) == 0) {
+        STATS_PRINT(sh, "Init thread stack: %zu bytes unused", unused);
+    }
+#endif
+}
+
+#if CONFIG_RGBLED_WIDGET_STATS_LOG_INTERVAL_S > 0
+static void led_stats_log_cb(struct k_work *work) {
+    led_stats_print(NULL);
+    k_work_schedule(k_work_delayable_from_work(work),
+                    K_SECONDS(CONFIG_RGBLED_WIDGET_STATS_LOG_INTERVAL_S));
+}
+
+static K_WORK_DELAYABLE_DEFINE(led_stats_log_work, led_stats_log_cb);
+#endif
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS_SHELL)
+static int cmd_rgbled_stats(const struct shell *sh, size_t argc, char **argv) {
+    led_stats_print(sh);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_rgbled,
+                               SHELL_CMD(stats, NULL, "Show LED indicator statistics",
+                                         cmd_rgbled_stats),
+                               SHELL_SUBCMD_SET_END);
+SHELL_CMD_REGISTER(rgbled, &sub_rgbled, "RGB LED widget commands", NULL);
+#endif
+#endif // IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+
+int rgbled_widget_show_pattern(uint8_t index, uint32_t arg) {
+    if (arg > RGBLED_PATTERN_ARG(RGBLED_WHITE, RGBLED_PATTERN_MAX_COUNT)) {
+        LOG_ERR("Pattern argument %u out of range", arg);
+        return -EINVAL;
+    }
+#if LED_PATTERN_CUSTOM_NUM > 0
+    if (index < LED_PATTERN_CUSTOM_NUM) {
+        struct blink_item blink = {
+            .pattern = LED_PATTERN_CUSTOM + index, .arg = arg, .requested = true};
+
+        LOG_INF("Showing pattern %d with argument %d", index, arg);
+        blink.priority = led_patterns[blink.pattern].priority;
+        blink.generation = led_queue_new_sequence(blink.priority);
+        led_queue_put(&blink);
+        return 0;
+    }
+#endif
+    LOG_ERR("Unknown pattern %d", index);
+    return -EINVAL;
+}
+
+void rgbled_widget_log_stats(void) {
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS)
+    led_stats_print(NULL);
+#else
+    LOG_WRN("Statistics need CONFIG_RGBLED_WIDGET_STATS to be enabled");
+#endif
+}
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_RUNTIME_CONFIG)
+// kinds of config items, deciding their range and the step of relative changes
+enum led_config_kind {
+    LED_CONFIG_DURATION,
+    LED_CONFIG_LEVEL,
+    LED_CONFIG_COLOR,
+};
+
+#define LED_CONFIG_ITEM(id, field, item_kind)                                                      \
+    [id] = {.offset = offsetof(struct led_config, field),                                          \
+            .size = sizeof(((struct led_config *)0)->field),                                       \
+            .kind = item_kind}
+
+// location of each config item in struct led_config, by RGBLED_CFG_* index
+static const struct led_config_item {
+    uint8_t offset;
+    uint8_t size;
+    uint8_t kind;
+} led_config_items[] = {
+    LED_CONFIG_ITEM(RGBLED_CFG_INTERVAL_MS, interval_ms, LED_CONFIG_DURATION),
+    LED_CONFIG_ITEM(RGBLED_CFG_BATTERY_BLINK_MS, battery_blink_ms, LED_CONFIG_DURATION),
+    LED_CONFIG_ITEM(RGBLED_CFG_CONN_BLINK_MS, conn_blink_ms, LED_CONFIG_DURATION),
+    LED_CONFIG_ITEM(RGBLED_CFG_LAYER_BLINK_MS, layer_blink_ms, LED_CONFIG_DURATION),
+    LED_CONFIG_ITEM(RGBLED_CFG_BATTERY_LEVEL_HIGH, battery_level_high, LED_CONFIG_LEVEL),
+    LED_CONFIG_ITEM(RGBLED_CFG_BATTERY_LEVEL_LOW, battery_level_low, LED_CONFIG_LEVEL),
+    LED_CONFIG_ITEM(RGBLED_CFG_BATTERY_LEVEL_CRITICAL, battery_level_critical, LED_CONFIG_LEVEL),
+    LED_CONFIG_ITEM(RGBLED_CFG_BATTERY_COLOR_HIGH, battery_color_high, LED_CONFIG_COLOR),
+    LED_CONFIG_ITEM(RGBLED_CFG_BATTERY_COLOR_MEDIUM, battery_color_medium, LED_CONFIG_COLOR),
+    LED_CONFIG_ITEM(RGBLED_CFG_BATTERY_COLOR_LOW, battery_color_low, LED_CONFIG_COLOR),
+    LED_CONFIG_ITEM(RGBLED_CFG_BATTERY_COLOR_CRITICAL, battery_color_critical, LED_CONFIG_COLOR),
+    LED_CONFIG_ITEM(RGBLED_CFG_BATTERY_COLOR_MISSING, battery_color_missing, LED_CONFIG_COLOR),
+    LED_CONFIG_ITEM(RGBLED_CFG_CONN_COLOR_CONNECTED, conn_color_connected, LED_CONFIG_COLOR),
+    LED_CONFIG_ITEM(RGBLED_CFG_CONN_COLOR_ADVERTISING, conn_color_advertising, LED_CONFIG_COLOR),
+    LED_CONFIG_ITEM(RGBLED_CFG_CONN_COLOR_DISCONNECTED, conn_color_disconnected, LED_CONFIG_COLOR),
+    LED_CONFIG_ITEM(RGBLED_CFG_CONN_COLOR_USB, conn_color_usb, LED_CONFIG_COLOR),
+    LED_CONFIG_ITEM(RGBLED_CFG_LAYER_COLOR, layer_color, LED_CONFIG_COLOR),
+};
+
+// look up an item, including the per-layer colors, returning false for unknown ids
+static bool led_config_item_get(uint32_t id, struct led_config_item *item) {
+    if (id >= RGBLED_CFG_LAYER_N_COLOR(0) &&
+        id < RGBLED_CFG_LAYER_N_COLOR(ARRAY_SIZE(led_config.layer_colors))) {
+        *item = (struct led_config_item){
+            .offset = offsetof(struct led_config, layer_colors) + id - RGBLED_CFG_LAYER_N_COLOR(0),
+            .size = 1,
+            .kind = LED_CONFIG_COLOR};
+        return true;
+    }
+    if (id < ARRAY_SIZE(led_config_items) && led_config_items[id].size > 0) {
+        *item = led_config_items[id];
+        return true;
+    }
+    return false;
+}
+
+static uint32_t led_config_item_read(const struct led_config_item *item) {
+    const uint8_t *ptr = (const uint8_t *)&led_config + item->offset;
+    uint16_t value;
+
+    if (item->size == 2) {
+        memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+    return *ptr;
+}
+
+static void led_config_item_write(const struct led_config_item *item, uint32_t value) {
+    uint8_t *ptr = (uint8_t *)&led_config + item->offset;
+
+    if (item->size == 2) {
+        uint16_t value16 = value;
+        memcpy(ptr, &value16, sizeof(value16));
+    } else {
+        *ptr = value;
+    }
+}
+
+static uint32_t led_config_item_max(const struct led_config_item *item) {
+    switch (item->kind) {
+    case LED_CONFIG_COLOR:
+        return ARRAY_SIZE(color_names) - 1;
+    case LED_CONFIG_LEVEL:
+        return 100;
+    default:
+        // the values above are the RGBLED_CFG_INC/DEC steps
+        return RGBLED_CFG_MS_MAX;
+    }
+}
+
+BUILD_ASSERT(CONFIG_RGBLED_WIDGET_BATTERY_LEVEL_CRITICAL < CONFIG_RGBLED_WIDGET_BATTERY_LEVEL_LOW &&
+                 CONFIG_RGBLED_WIDGET_BATTERY_LEVEL_LOW < CONFIG_RGBLED_WIDGET_BATTERY_LEVEL_HIGH,
+             "Battery levels must be ordered as critical < low < high for runtime changes");
+
+// the battery thresholds must stay ordered as critical < low < high, so that each band is shown,
+// which limits each one to the range between its neighbors
+static void led_config_item_range(uint32_t id, const struct led_config_item *item, uint32_t *min,
+                                  uint32_t *max) {
+    *min = 0;
+    *max = led_config_item_max(item);
+
+    switch (id) {
+    case RGBLED_CFG_BATTERY_LEVEL_HIGH:
+        *min = led_config.battery_level_low + 1;
+        break;
+    case RGBLED_CFG_BATTERY_LEVEL_LOW:
+        *min = led_config.battery_level_critical + 1;
+        *max = led_config.battery_level_high - 1;
+        break;
+    case RGBLED_CFG_BATTERY_LEVEL_CRITICAL:
+        *max = led_config.battery_level_low - 1;
+        break;
+    default:
+        break;
+    }
+}
+
+// check all items after loading, so that e.g. colors can be used as indices safely
+static bool led_config_is_valid(void) {
+    struct led_config_item item;
+
+    for (uint32_t id = 0; id < RGBLED_CFG_LAYER_N_COLOR(ARRAY_SIZE(led_config.layer_colors));
+         id++) {
+        if (led_config_item_get(id, &item) &&
+            led_config_item_read(&item) > led_config_item_max(&item)) {
+            return false;
+        }
+    }
+    return led_config.battery_level_critical < led_config.battery_level_low &&
+           led_config.battery_level_low < led_config.battery_level_high;
+}
+
+#if IS_ENABLED(CONFIG_SETTINGS)
+static void led_config_save_cb(struct k_work *work) {
+    int err = settings_save_one("rgbled_widget/config", &led_config, sizeof(led_config));
+    if (err < 0) {
+        LOG_ERR("Failed to save LED widget config: %d", err);
+    }
+}
+
+static K_WORK_DELAYABLE_DEFINE(led_config_save_work, led_config_save_cb);
+
+static int led_config_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+                                   void *cb_arg) {
+    const char *next;
+
+    if (!settings_name_steq(name, "config", &next) || next != NULL) {
+        return -ENOENT;
+    }
+    // a saved config from a version with a different layout is dropped for the defaults
+    if (len != sizeof(led_config)) {
+        LOG_WRN("Ignoring saved LED widget config with unexpected size %zu", len);
+        return 0;
+    }
+
+    int rc = read_cb(cb_arg, &led_config, sizeof(led_config));
+    if (rc < 0 || !led_config_is_valid()) {
+        LOG_WRN("Ignoring invalid saved LED widget config");
+        led_config = (struct led_config)LED_CONFIG_DEFAULTS;
+    }
+    return MIN(rc, 0);
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(rgbled_widget, "rgbled_widget", NULL, led_config_settings_set, NULL,
+                               NULL);
+#endif // IS_ENABLED(CONFIG_SETTINGS)
+
+int rgbled_widget_config_set(uint32_t id, uint32_t value) {
+    if (id == RGBLED_CFG_RESET) {
+        LOG_INF("Restoring default LED widget config");
+        led_config = (struct led_config)LED_CONFIG_DEFAULTS;
+    } else {
+        struct led_config_item item;
+
+        if (!led_config_item_get(id, &item)) {
+            LOG_ERR("Unknown LED widget config item %d", id);
+            return -EINVAL;
+        }
+
+        uint32_t current = led_config_item_read(&item);
+        uint32_t min, max;
+        uint32_t step = item.kind == LED_CONFIG_COLOR   ? 1
+                        : item.kind == LED_CONFIG_LEVEL ? 5
+                                                        : 50;
+
+        led_config_item_range(id, &item, &min, &max);
+        // colors wrap around when stepping, other values stop at their limits
+        if (value == RGBLED_CFG_INC) {
+            value = item.kind == LED_CONFIG_COLOR ? (current + 1) % (max + 1)
+                                                  : MIN(current + step, max);
+        } else if (value == RGBLED_CFG_DEC) {
+            value = item.kind == LED_CONFIG_COLOR ? (current + max) % (max + 1)
+                                                  : MAX(current, min + step) - step;
+        } else if (value < min || value > max) {
+            LOG_ERR("Value %d out of range for LED widget config item %d", value, id);
+            return -EINVAL;
+        }
+
+        if (value == current) {
+            return 0;
+        }
+        LOG_INF("Setting LED widget config item %d to %d", id, value);
+        led_config_item_write(&item, value);
+    }
+
+#if SHOW_LAYER_COLORS
+    // the only persistent state using config items
+    if (initialized) {
+        update_layer_color();
+    }
+#endif
+#if IS_ENABLED(CONFIG_SETTINGS)
+    // coalesce quick successive changes into a single flash write
+    k_work_reschedule(&led_config_save_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
+#endif
+    return 0;
+}
+#endif // IS_ENABLED(CONFIG_RGBLED_WIDGET_RUNTIME_CONFIG)
+
+static void led_gpio_init(void) {
+#if LED_GPIO_PORT
+    // the gpio-leds driver configures the pins as well, but is not relied on for it
+    for (uint8_t i = 0; i < ARRAY_SIZE(led_groups); i++) {
+        for (uint8_t pos = 0; pos < 3; pos++) {
+            const struct gpio_dt_spec *gpio = &led_groups[i].gpios[pos];
+            if (!gpio_is_ready_dt(gpio) || gpio_pin_configure_dt(gpio, GPIO_OUTPUT_INACTIVE) < 0) {
+                LOG_ERR("Failed to configure GPIO pin %d of group %d", gpio->pin, i);
+            }
+        }
+    }
+#endif
+}
+
+static void led_config_load(void) {
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_RUNTIME_CONFIG) && IS_ENABLED(CONFIG_SETTINGS)
+    settings_subsys_init();
+
+    int err = settings_load_subtree("rgbled_widget");
+    if (err < 0) {
+        LOG_ERR("Failed to load LED widget config: %d", err);
+    }
+#endif
+}
+
+// initial boot up sequence: battery level, then connectivity status and layer color
+#if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+static void led_init_battery(void) {
+    // check and indicate battery level on start
+    LOG_INF("Indicating initial battery status");
+
+    indicate_battery_internal(false);
+}
+#endif // IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+
+static void led_init_finish(void) {
+    // check and indicate current profile or peripheral connectivity status
+    LOG_INF("Indicating initial connectivity status");
+    k_work_reschedule(&indicate_connectivity_work, K_MSEC(16));
+
+#if SHOW_LAYER_COLORS
+    LOG_INF("Setting initial layer color");
+    update_layer_color();
+#endif // SHOW_LAYER_COLORS
+
+    initialized = true;
+    LOG_INF("Finished initializing LED widget");
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_STATS) && CONFIG_RGBLED_WIDGET_STATS_LOG_INTERVAL_S > 0
+    k_work_schedule(&led_stats_log_work, K_SECONDS(CONFIG_RGBLED_WIDGET_STATS_LOG_INTERVAL_S));
+#endif
+}
+
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_SEQUENCER_THREAD)
+extern void led_process_thread(void *d0, void *d1, void *d2) {
+    struct led_group *grp = d0;
+    ARG_UNUSED(d1);
+    ARG_UNUSED(d2);
+
+    grp->tid = k_current_get();
+    while (true) {
+        // wait until a blink item is received and process it
+        if (!led_queue_get(grp, &grp->seq_item)) {
+            k_sem_take(&grp->queue_sem, K_FOREVER);
+            continue;
+        }
+        grp->seq_step = 0;
+        grp->seq_active = true;
+
+        int32_t hold_ms;
+        while ((hold_ms = led_seq_next_step(grp)) >= 0) {
+            // k_wakeup cuts a hold short when the item is superseded, sleep the rest otherwise
+            while (hold_ms > 0 && !led_seq_superseded(grp)) {
+                hold_ms = k_sleep(K_MSEC(hold_ms));
+            }
+        }
+        grp->seq_active = false;
+    }
+}
+
+// define a led_process_thread for each group with stack size 1024, start running them 100 ms
+// after boot
+#define LED_PROCESS_THREAD_DEFINE(n, _)                                                            \
+    K_THREAD_DEFINE(led_process_tid_##n, 1024, led_process_thread, &led_groups[n], NULL, NULL,    \
+                    K_LOWEST_APPLICATION_THREAD_PRIO, 0, 100)
+
+LISTIFY(LED_GROUP_NUM, LED_PROCESS_THREAD_DEFINE, (;));
+
+extern void led_init_thread(void *d0, void *d1, void *d2) {
+    ARG_UNUSED(d0);
+    ARG_UNUSED(d1);
+    ARG_UNUSED(d2);
+
+#if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+    led_init_battery();
+
+    // wait until blink should be displayed for further checks
+    k_sleep(K_MSEC(led_config.battery_blink_ms + led_config.interval_ms));
+#endif // IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+
+    led_init_finish();
+}
+
+// run init thread on boot for initial battery+output checks
+K_THREAD_DEFINE(led_init_tid, 1024, led_init_thread, NULL, NULL, NULL,
+                K_LOWEST_APPLICATION_THREAD_PRIO, 0, 200);
+
+static int led_widget_init(void) {
+    led_config_load();
+    led_gpio_init();
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(led_groups); i++) {
+        k_sem_init(&led_groups[i].queue_sem, 0, 1);
+    }
+    return 0;
+}
+
+SYS_INIT(led_widget_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#elif IS_ENABLED(CONFIG_RGBLED_WIDGET_SEQUENCER_WORKQUEUE)
+static void led_sequencer_cb(struct k_work *work) {
+    struct led_group *grp =
+        CONTAINER_OF(k_work_delayable_from_work(work), struct led_group, seq_work);
+
+    // led_queue_put can kick us while a step is being held, so wait out the rest of it unless
+    // the item was superseded
+    int64_t remaining_ms = grp->seq_deadline - k_uptime_get();
+    if (grp->seq_active && remaining_ms > 0 && !led_seq_superseded(grp)) {
+        k_work_schedule(&grp->seq_work, K_MSEC(remaining_ms));
+        return;
+    }
+
+    while (true) {
+        if (!grp->seq_active) {
+            // go idle until the next led_queue_put if there is nothing to process
+            if (!led_queue_get(grp, &grp->seq_item)) {
+                return;
+            }
+            grp->seq_step = 0;
+            grp->seq_active = true;
+        }
+
+        int32_t hold_ms = led_seq_next_step(grp);
+        if (hold_ms < 0) {
+            grp->seq_active = false;
+        } else if (hold_ms > 0) {
+            grp->seq_deadline = k_uptime_get() + hold_ms;
+            k_work_schedule(&grp->seq_work, K_MSEC(hold_ms));
+            return;
+        }
+    }
+}
+
+static void led_init_finish_cb(struct k_work *work) { led_init_finish(); }
+static K_WORK_DELAYABLE_DEFINE(led_init_finish_work, led_init_finish_cb);
+
+#if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+static void led_init_battery_cb(struct k_work *work) {
+    led_init_battery();
+
+    // chain the rest of the sequence once the battery blink should be displayed
+    k_work_schedule(&led_init_finish_work, K_MSEC(led_config.battery_blink_ms +
+                                                  led_config.interval_ms));
+}
+static K_WORK_DELAYABLE_DEFINE(led_init_battery_work, led_init_battery_cb);
+#endif // IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+
+static int led_widget_init(void) {
+    led_config_load();
+    led_gpio_init();
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(led_groups); i++) {
+        k_work_init_delayable(&led_groups[i].seq_work, led_sequencer_cb);
+    }
+
+    // start the boot up sequence at the same time the init thread would have
+#if IS_ENABLED(CONFIG_ZMK_BATTERY_REPORTING)
+    k_work_schedule(&led_init_battery_work, K_MSEC(200));
+#else
+    k_work_schedule(&led_init_finish_work, K_MSEC(200));
+#endif
+    return 0;
+}
+
+SYS_INIT(led_widget_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+#endif // IS_ENABLED(CONFIG_RGBLED_WIDGET_SEQUENCER_WORKQUEUE)
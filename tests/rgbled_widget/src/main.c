@@ -0,0 +1,307 @@
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include <zmk/events/battery_state_changed.h>
+#include <zmk/events/ble_active_profile_changed.h>
+#include <zmk/events/layer_state_changed.h>
+#include <zmk/events/split_peripheral_status_changed.h>
+
+#include <zmk_rgbled_widget/widget.h>
+
+#include "mock_leds.h"
+#include "mock_zmk.h"
+
+#define IS_CENTRAL (!IS_ENABLED(CONFIG_ZMK_SPLIT) || IS_ENABLED(CONFIG_ZMK_SPLIT_ROLE_CENTRAL))
+
+// debounce of connectivity events in the widget
+#define CONN_DEBOUNCE_MS 16
+
+// allowed slack on top of the configured debounce and blink durations, so that a regression in
+// the sequencer, e.g. an extra wait or a blink that is not cut short, fails the test
+#define LATENCY_MARGIN_MS 10
+#define SEQUENCE_MARGIN_MS 20
+
+// upper bound for the queue length during bursts, superseded sequences should not pile up
+#define MAX_QUEUE_HIGH_WATER 3
+
+// time without LED changes after which no sequence is in progress any more, longer than the
+// pauses between and within blinks
+#define IDLE_MS (CONFIG_RGBLED_WIDGET_LAYER_DEBOUNCE_MS + CONFIG_RGBLED_WIDGET_INTERVAL_MS + 500)
+
+// when the LEDs first lit up after an event, how long until they went dark for the last time, and
+// how many times they lit up in between
+struct measurement {
+    int64_t first_light_ms;
+    int64_t sequence_ms;
+    uint32_t blinks;
+};
+
+static struct measurement measure(const char *name, int64_t since) {
+    const struct mock_led_change *changes;
+    size_t len = mock_leds_get(&changes);
+    struct measurement m = {.first_light_ms = -1, .sequence_ms = -1};
+    int64_t first_on = -1;
+    uint32_t lit = 0;
+
+    zassert_equal(mock_leds_overflows(), 0, "LED change log overflowed");
+
+    // the LEDs are dark at the start of each test, see settle
+    for (size_t i = 0; i < len; i++) {
+        uint32_t was_lit = lit;
+
+        WRITE_BIT(lit, changes[i].led, changes[i].on);
+        if (!was_lit && lit) {
+            if (first_on < 0) {
+                first_on = changes[i].time_ms;
+            }
+            m.blinks++;
+        } else if (was_lit && !lit) {
+            m.sequence_ms = changes[i].time_ms - first_on;
+        }
+    }
+    if (first_on >= 0) {
+        m.first_light_ms = first_on - since;
+    }
+
+    TC_PRINT("%s: first light after %lld ms, sequence of %u blinks in %lld ms\n", name,
+             (long long)m.first_light_ms, m.blinks, (long long)m.sequence_ms);
+    zassert_equal(lit, 0, "LEDs still lit after %s", name);
+    return m;
+}
+
+static struct rgbled_widget_stats report_stats(const char *name) {
+    struct rgbled_widget_stats stats;
+
+    rgbled_widget_get_stats(&stats);
+    TC_PRINT("%s: %u queued, %u superseded, %u unchanged, %u dropped, queue high water mark %u, "
+             "%u layers relayed\n",
+             name, stats.queued, stats.superseded, stats.unchanged, stats.dropped,
+             stats.queue_high_water, stats.relayed);
+    return stats;
+}
+
+#if IS_CENTRAL
+static void raise_layer(uint8_t layer) {
+    mock_zmk_highest_layer = layer;
+    raise_zmk_layer_state_changed((struct zmk_layer_state_changed){
+        .layer = layer, .state = true, .timestamp = k_uptime_get()});
+}
+
+static void raise_ble_profile(uint8_t profile) {
+    mock_zmk_ble_profile = profile;
+    raise_zmk_ble_active_profile_changed(
+        (struct zmk_ble_active_profile_changed){.index = profile, .profile = NULL});
+}
+#else
+static void raise_split_status(bool connected) {
+    mock_zmk_peripheral_connected = connected;
+    raise_zmk_split_peripheral_status_changed(
+        (struct zmk_split_peripheral_status_changed){.connected = connected});
+}
+#endif
+
+static void raise_battery(uint8_t level) {
+    mock_zmk_battery_level = level;
+    raise_zmk_battery_state_changed((struct zmk_battery_state_changed){.state_of_charge = level});
+}
+
+// periods in ms at which each event is raised during a burst, 0 to leave it out
+struct burst_script {
+    uint32_t duration_ms;
+    uint32_t layer_ms;
+    uint32_t connectivity_ms;
+    uint32_t battery_ms;
+};
+
+// raise events as scripted, returning the uptime at the end of the burst
+static int64_t run_burst(const struct burst_script *script) {
+    int64_t start = k_uptime_get();
+
+    for (uint32_t t = 0; t < script->duration_ms; t += 10) {
+        if (script->layer_ms > 0 && t % script->layer_ms == 0) {
+#if IS_CENTRAL
+            raise_layer(1 + (t / script->layer_ms) % 3);
+#endif
+        }
+        if (script->connectivity_ms > 0 && t % script->connectivity_ms == 0) {
+#if IS_CENTRAL
+            raise_ble_profile((t / script->connectivity_ms) % 2);
+#else
+            raise_split_status((t / script->connectivity_ms) % 2);
+#endif
+        }
+        // levels above the critical one, so that they do not blink
+        if (script->battery_ms > 0 && t % script->battery_ms == 0) {
+            raise_battery(80 - (t / script->battery_ms) % 10);
+        }
+        k_sleep(K_TIMEOUT_ABS_MS(start + t + 10));
+    }
+    return k_uptime_get();
+}
+
+// wait until the blinks for earlier events are over, then start recording from dark LEDs
+static void settle(void) {
+    const struct mock_led_change *changes;
+    int tries = 0;
+
+    do {
+        zassert_true(tries++ < 10, "LEDs kept changing");
+        mock_leds_clear();
+        k_sleep(K_MSEC(IDLE_MS));
+    } while (mock_leds_get(&changes) > 0);
+
+    zassert_equal(mock_leds_lit(), 0, "LEDs lit before the test");
+    rgbled_widget_reset_stats();
+}
+
+static void *rgbled_widget_setup(void) {
+    // events are ignored until the boot sequence has finished
+    k_sleep(K_SECONDS(5));
+    return NULL;
+}
+
+static void rgbled_widget_before(void *fixture) {
+    ARG_UNUSED(fixture);
+
+    // return the mocks to their defaults and let the widget follow them, so that nothing a test
+    // leaves behind changes the outcome of the next one
+    mock_zmk_reset();
+    raise_battery(mock_zmk_battery_level);
+#if IS_CENTRAL
+    raise_layer(mock_zmk_highest_layer);
+    raise_ble_profile(mock_zmk_ble_profile);
+#else
+    raise_split_status(mock_zmk_peripheral_connected);
+#endif
+    settle();
+}
+
+ZTEST_SUITE(rgbled_widget, NULL, rgbled_widget_setup, rgbled_widget_before, NULL, NULL);
+
+ZTEST(rgbled_widget, test_battery_critical) {
+    int64_t start = k_uptime_get();
+
+    raise_battery(CONFIG_RGBLED_WIDGET_BATTERY_LEVEL_CRITICAL - 1);
+    k_sleep(K_MSEC(CONFIG_RGBLED_WIDGET_BATTERY_BLINK_MS + 1000));
+    raise_battery(80);
+
+    struct measurement m = measure("critical battery", start);
+    zassert_equal(m.blinks, 1);
+    zassert_between_inclusive(m.first_light_ms, 0, LATENCY_MARGIN_MS);
+    zassert_true(m.sequence_ms <= CONFIG_RGBLED_WIDGET_BATTERY_BLINK_MS + SEQUENCE_MARGIN_MS);
+    zassert_equal(report_stats("critical battery").dropped, 0);
+}
+
+ZTEST(rgbled_widget, test_connectivity_change) {
+    int64_t start = k_uptime_get();
+
+#if IS_CENTRAL
+    raise_ble_profile(1);
+#else
+    raise_split_status(true);
+#endif
+    k_sleep(K_MSEC(CONFIG_RGBLED_WIDGET_CONN_BLINK_MS + 1000));
+
+    struct measurement m = measure("connectivity change", start);
+    zassert_equal(m.blinks, 1);
+    zassert_between_inclusive(m.first_light_ms, 0, CONN_DEBOUNCE_MS + LATENCY_MARGIN_MS);
+    zassert_true(m.sequence_ms <= CONFIG_RGBLED_WIDGET_CONN_BLINK_MS + SEQUENCE_MARGIN_MS);
+    zassert_equal(report_stats("connectivity change").dropped, 0);
+}
+
+ZTEST(rgbled_widget, test_layer_change) {
+#if SHOW_LAYER_CHANGE
+    raise_layer(0);
+    settle();
+
+    int64_t start = k_uptime_get();
+
+    raise_layer(2);
+    k_sleep(K_SECONDS(2));
+
+    // two blinks with a pause in between for layer 2
+    struct measurement m = measure("layer change", start);
+    zassert_equal(m.blinks, 2);
+    zassert_between_inclusive(m.first_light_ms, 0,
+                              CONFIG_RGBLED_WIDGET_LAYER_DEBOUNCE_MS + LATENCY_MARGIN_MS);
+    zassert_true(m.sequence_ms <= 3 * CONFIG_RGBLED_WIDGET_LAYER_BLINK_MS + SEQUENCE_MARGIN_MS);
+    zassert_equal(report_stats("layer change").dropped, 0);
+#else
+    ztest_test_skip();
+#endif
+}
+
+ZTEST(rgbled_widget, test_layer_relay) {
+#if IS_ENABLED(CONFIG_RGBLED_WIDGET_LAYER_RELAY_LOOPBACK)
+    // time for a layer change to be relayed, with some slack for the work queue
+    const k_timeout_t relay_wait = K_MSEC(CONFIG_RGBLED_WIDGET_LAYER_RELAY_DELAY_MS + 10);
+    struct rgbled_widget_stats stats;
+
+    raise_layer(0);
+    settle();
+
+    // a new highest layer is sent once
+    raise_layer(1);
+    k_sleep(relay_wait);
+    rgbled_widget_get_stats(&stats);
+    zassert_equal(stats.relayed, 1);
+
+    // events that leave the highest layer as it is are not sent again
+    raise_layer(1);
+    k_sleep(relay_wait);
+    rgbled_widget_get_stats(&stats);
+    zassert_equal(stats.relayed, 1);
+
+    // quick changes within the relay delay are sent together, as the last of them
+    raise_layer(2);
+    raise_layer(3);
+    raise_layer(2);
+    k_sleep(relay_wait);
+    rgbled_widget_get_stats(&stats);
+    zassert_equal(stats.relayed, 2);
+
+    // returning to the base layer is sent as well
+    raise_layer(0);
+    k_sleep(relay_wait);
+    report_stats("layer relay");
+    rgbled_widget_get_stats(&stats);
+    zassert_equal(stats.relayed, 3);
+#else
+    ztest_test_skip();
+#endif
+}
+
+ZTEST(rgbled_widget, test_event_burst) {
+    // layer changes at 50 Hz, connectivity changes at 10 Hz and battery reports at 4 Hz
+    const struct burst_script script = {
+        .duration_ms = 2000, .layer_ms = 20, .connectivity_ms = 100, .battery_ms = 250};
+
+#if IS_CENTRAL
+    raise_layer(0);
+    settle();
+#endif
+
+    int64_t start = k_uptime_get();
+    int64_t end = run_burst(&script);
+
+    k_sleep(K_SECONDS(5));
+
+    // the last connectivity blink, after the interval following one that it cut short, then the
+    // debounced indication of layer 1 to 3 if shown
+    struct measurement m = measure("event burst", start);
+    int64_t settle_ms = start + m.first_light_ms + m.sequence_ms - end;
+    int64_t max_settle_ms = CONN_DEBOUNCE_MS + CONFIG_RGBLED_WIDGET_INTERVAL_MS +
+                            CONFIG_RGBLED_WIDGET_CONN_BLINK_MS + SEQUENCE_MARGIN_MS;
+#if SHOW_LAYER_CHANGE
+    max_settle_ms += CONFIG_RGBLED_WIDGET_INTERVAL_MS + 5 * CONFIG_RGBLED_WIDGET_LAYER_BLINK_MS;
+#endif
+    TC_PRINT("event burst: settled %lld ms after the last event\n", (long long)settle_ms);
+    zassert_true(m.blinks > 0);
+    zassert_true(settle_ms <= max_settle_ms, "settled after %lld ms, more than %lld ms",
+                 (long long)settle_ms, (long long)max_settle_ms);
+
+    struct rgbled_widget_stats stats = report_stats("event burst");
+    zassert_equal(stats.dropped, 0);
+    zassert_true(stats.queue_high_water <= MAX_QUEUE_HIGH_WATER);
+}
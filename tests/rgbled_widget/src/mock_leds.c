@@ -0,0 +1,91 @@
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/util.h>
+
+#include "mock_leds.h"
+
+#define MOCK_LEDS_NODE DT_NODELABEL(mock_leds)
+#define MOCK_LEDS_LOG_SIZE 1024
+
+#define MOCK_LED_GPIO(node_id) GPIO_DT_SPEC_GET(node_id, gpios)
+
+// pins of the gpio-leds children, in the order of their indices
+static const struct gpio_dt_spec mock_gpios[] = {
+    DT_FOREACH_CHILD_SEP(MOCK_LEDS_NODE, MOCK_LED_GPIO, (, ))};
+
+static struct gpio_callback mock_callbacks[ARRAY_SIZE(mock_gpios)];
+static struct mock_led_change mock_log[MOCK_LEDS_LOG_SIZE];
+static size_t mock_log_len;
+static size_t mock_log_overflows;
+static uint32_t mock_lit;
+static struct k_spinlock lock;
+
+static void mock_leds_changed(const struct device *port, struct gpio_callback *cb,
+                              gpio_port_pins_t pins) {
+    uint8_t led = cb - mock_callbacks;
+
+    // the LEDs are active high, so the output level of the pin tells whether the LED is lit
+    bool on = gpio_emul_output_get(port, mock_gpios[led].pin) > 0;
+
+    K_SPINLOCK(&lock) {
+        // only actual changes are recorded, like they would be visible on real LEDs
+        if (on != ((mock_lit & BIT(led)) != 0)) {
+            WRITE_BIT(mock_lit, led, on);
+            if (mock_log_len < ARRAY_SIZE(mock_log)) {
+                mock_log[mock_log_len++] =
+                    (struct mock_led_change){.time_ms = k_uptime_get(), .led = led, .on = on};
+            } else {
+                mock_log_overflows++;
+            }
+        }
+    }
+}
+
+// the gpio-leds driver configures its pins as outputs only. With the input enabled as well, the
+// emulated GPIO controller loops every output change back to the input and raises an edge
+// interrupt for it, which is where the change is recorded
+static int mock_leds_init(void) {
+    for (uint8_t i = 0; i < ARRAY_SIZE(mock_gpios); i++) {
+        int ret = gpio_pin_configure_dt(&mock_gpios[i], GPIO_INPUT | GPIO_OUTPUT_INACTIVE);
+
+        if (ret == 0) {
+            ret = gpio_pin_interrupt_configure_dt(&mock_gpios[i], GPIO_INT_EDGE_BOTH);
+        }
+        if (ret == 0) {
+            gpio_init_callback(&mock_callbacks[i], mock_leds_changed, BIT(mock_gpios[i].pin));
+            ret = gpio_add_callback_dt(&mock_gpios[i], &mock_callbacks[i]);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+// after the LED driver has set up the pins, before the widget can light any of them
+SYS_INIT(mock_leds_init, POST_KERNEL, 99);
+
+void mock_leds_clear(void) {
+    K_SPINLOCK(&lock) {
+        mock_log_len = 0;
+        mock_log_overflows = 0;
+    }
+}
+
+size_t mock_leds_get(const struct mock_led_change **changes) {
+    *changes = mock_log;
+    return mock_log_len;
+}
+
+size_t mock_leds_overflows(void) { return mock_log_overflows; }
+
+uint32_t mock_leds_lit(void) {
+    uint32_t lit;
+
+    K_SPINLOCK(&lock) { lit = mock_lit; }
+    return lit;
+}
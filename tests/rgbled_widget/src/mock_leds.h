@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// a mock LED turning on or off, with the uptime in ms when it happened
+struct mock_led_change {
+    int64_t time_ms;
+    uint8_t led;
+    bool on;
+};
+
+// forget the recorded changes, keeping the current LED states
+void mock_leds_clear(void);
+
+// changes recorded since the last clear, oldest first, and the number of them
+size_t mock_leds_get(const struct mock_led_change **changes);
+
+// number of changes that were not recorded because the log was full
+size_t mock_leds_overflows(void);
+
+// bit mask of the LEDs that are currently lit
+uint32_t mock_leds_lit(void);
@@ -0,0 +1,40 @@
+#include <zephyr/logging/log.h>
+
+#include <zmk/battery.h>
+#include <zmk/ble.h>
+#include <zmk/endpoints.h>
+#include <zmk/keymap.h>
+#include <zmk/split/bluetooth/peripheral.h>
+
+#include "mock_zmk.h"
+
+// the widget logs to the zmk module, which is registered by the ZMK app otherwise
+LOG_MODULE_REGISTER(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+uint8_t mock_zmk_highest_layer;
+uint8_t mock_zmk_battery_level = 80;
+uint8_t mock_zmk_ble_profile;
+bool mock_zmk_peripheral_connected;
+
+void mock_zmk_reset(void) {
+    mock_zmk_highest_layer = 0;
+    mock_zmk_battery_level = 80;
+    mock_zmk_ble_profile = 0;
+    mock_zmk_peripheral_connected = false;
+}
+
+uint8_t zmk_keymap_highest_layer_active(void) { return mock_zmk_highest_layer; }
+
+uint8_t zmk_battery_state_of_charge(void) { return mock_zmk_battery_level; }
+
+int zmk_ble_active_profile_index(void) { return mock_zmk_ble_profile; }
+
+bool zmk_ble_active_profile_is_open(void) { return false; }
+
+struct zmk_endpoint_instance zmk_endpoint_get_selected(void) {
+    return (struct zmk_endpoint_instance){.transport = ZMK_TRANSPORT_BLE};
+}
+
+enum zmk_transport zmk_endpoint_get_preferred_transport(void) { return ZMK_TRANSPORT_BLE; }
+
+bool zmk_split_bt_peripheral_is_connected(void) { return mock_zmk_peripheral_connected; }
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// state returned by the mocked ZMK functions, set by the tests before raising the matching event
+extern uint8_t mock_zmk_highest_layer;
+extern uint8_t mock_zmk_battery_level;
+extern uint8_t mock_zmk_ble_profile;
+extern bool mock_zmk_peripheral_connected;
+
+// set the mocked state back to its defaults, without raising any events
+void mock_zmk_reset(void);